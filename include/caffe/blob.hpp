@@ -263,6 +263,15 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to data, which may be larger
+   *        than this Blob -- used by Net to place activations that are never
+   *        live at the same time in one memory arena.
+   *
+   * The diff_ is left alone. Later Reshape%s keep the shared data_ for as
+   * long as they fit in it.
+   */
+  void ShareData(const shared_ptr<SyncedMemory>& data);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_view.hpp"
 
 namespace caffe {
 
@@ -37,6 +38,52 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation to a DatumView, typically parsed by
+   * ParseDatumView() straight from a database record, which saves copying
+   * the pixels into a Datum. The view must not be encoded.
+   *
+   * @param datum
+   *    DatumView of the data to be transformed.
+   * @param transformed_blob
+   *    This is destination blob, as for a Datum.
+   */
+  void Transform(const DatumView& datum, Blob<Dtype>* transformed_blob);
+
+  /**
+   * @brief Does the part of the transformation that needs the source data:
+   *    copies the uint8 crop of a raw DatumView to raw_crop and stores its
+   *    offsets and whether to mirror it in crop[0], crop[1] and crop[2].
+   *    TransformRaw_cpu or TransformRaw_gpu applies the rest later, which
+   *    lets a batch travel to the device as bytes.
+   *
+   * @param datum
+   *    DatumView of raw uint8 data.
+   * @param transformed_blob
+   *    Blob with the shape of one item of the batch, which the crop has to
+   *    match as for Transform.
+   * @param raw_crop
+   *    Destination of the channels x crop x crop bytes, or of the whole
+   *    image without crop_size.
+   * @param crop
+   *    Destination of the 3 crop parameters.
+   */
+  void CropRaw(const DatumView& datum, const Blob<Dtype>& transformed_blob,
+               uint8_t* raw_crop, int* crop);
+
+  /**
+   * @brief Subtracts the mean, scales and mirrors a batch of crops made by
+   *    CropRaw, with the same result as Transform. The crops have the
+   *    shape of transformed_blob, and their parameters are stored back to
+   *    back in crops.
+   */
+  void TransformRaw_cpu(const uint8_t* raw_crops, const int* crops,
+      Blob<Dtype>* transformed_blob);
+  // Same with raw_crops and crops on the device, into the device data of
+  // transformed_blob
+  void TransformRaw_gpu(const uint8_t* raw_crops, const int* crops,
+      Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -98,6 +145,7 @@ class DataTransformer {
    *    Datum containing the data to be transformed.
    */
   vector<int> InferBlobShape(const Datum& datum);
+  vector<int> InferBlobShape(const DatumView& datum);
   /**
    * @brief Infers the shape of transformed_blob will have when
    *    the transformation is applied to the data.
@@ -138,7 +186,11 @@ class DataTransformer {
    */
   virtual int Rand(int n);
 
-  void Transform(const Datum& datum, Dtype* transformed_data);
+  // Checks a datum of the given shape against the mean, and picks the
+  // offsets of its crop and whether to mirror it
+  void PickCrop(int datum_channels, int datum_height, int datum_width,
+      int* h_off, int* w_off, bool* do_mirror);
+  void Transform(const DatumView& datum, Dtype* transformed_data);
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -147,6 +199,8 @@ class DataTransformer {
   Phase phase_;
   Blob<Dtype> data_mean_;
   vector<Dtype> mean_values_;
+  // mean_values_ for TransformRaw_gpu
+  Blob<Dtype> mean_values_blob_;
 };
 
 }  // namespace caffe
@@ -269,6 +269,31 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward makes the top blobs share the data of the
+   *        first bottom blob instead of writing their own, as Split does.
+   *
+   * Net keeps such blobs in the same memory when it shares activations.
+   */
+  virtual inline bool ForwardSharesData() const { return false; }
+
+  /**
+   * @brief Returns the bytes of scratch memory the layer needs in Forward and
+   *        Backward at its current shape, e.g. for im2col.
+   *
+   * Only one layer of a Net runs at a time, so the Net lends a single
+   * workspace of the largest size to all of its layers by SetWorkspace().
+   */
+  virtual inline size_t WorkspaceSize() const { return 0; }
+  /**
+   * @brief Lends the layer scratch memory of at least WorkspaceSize() bytes,
+   *        shared with the other layers of a Net.
+   *
+   * A layer without a workspace, or whose Reshape outgrows it, uses memory
+   * of its own.
+   */
+  virtual void SetWorkspace(const shared_ptr<SyncedMemory>& workspace) {}
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
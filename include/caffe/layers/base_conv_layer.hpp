@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/openmp.hpp"
 
 namespace caffe {
 
@@ -28,19 +29,47 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  // The column buffers are the workspace; 1x1 convolutions need none.
+  virtual inline size_t WorkspaceSize() const {
+    return is_1x1_ ? 0 : num_workers_ * col_buffer_.count() * sizeof(Dtype);
+  }
+  virtual void SetWorkspace(const shared_ptr<SyncedMemory>& workspace) {
+    col_buffer_.ShareData(workspace);
+  }
+
  protected:
-  // Helper functions that abstract away the column buffer and gemm arguments.
+  // Helper functions that abstract away the gemm arguments. The CPU versions
+  // take the column buffer of the calling worker, see worker_col_buffer.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
   // we just called weight_cpu_gemm with the same input.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, Dtype* col_buff, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, Dtype* col_buff);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, Dtype* col_buff);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
 
+  // The CPU passes split the images of the batch among num_workers_ threads.
+  // Each worker has a column buffer of its own, and accumulates the parameter
+  // gradients on its own slice of worker_diffs, which reduce_worker_diffs then
+  // adds to the parameter in worker order.
+  /// @brief The column buffers of all workers, or NULL for 1x1 convolution.
+  Dtype* cpu_col_buffers();
+  /// @brief The column buffer of the calling worker.
+  inline Dtype* worker_col_buffer(Dtype* col_buffers) {
+    return col_buffers ?
+        col_buffers + caffe_omp_thread_num() * col_buffer_.count() : NULL;
+  }
+  /// @brief Zeroed per-worker gradients for param, or its diff for 1 worker.
+  Dtype* worker_diffs(Blob<Dtype>* param, Blob<Dtype>* buffer);
+  /// @brief The gradient slice of the calling worker.
+  inline Dtype* worker_diff(Dtype* diffs, const Blob<Dtype>& param) {
+    return diffs + caffe_omp_thread_num() * param.count();
+  }
+  void reduce_worker_diffs(const Blob<Dtype>& buffer, Blob<Dtype>* param);
+
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
@@ -92,6 +121,13 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// CPU threads working on the images of the batch at once.
+  int num_workers_;
+  /// The most column buffer memory that several workers may take together.
+  static const size_t kMaxWorkerWorkspace = 64 << 20;
+  /// Per-worker weight and bias gradients of the CPU backward pass.
+  Blob<Dtype> worker_weight_diff_;
+  Blob<Dtype> worker_bias_diff_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -165,6 +201,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int col_offset_;
   int output_offset_;
 
+  /// The column buffer of one image; CPU workers have num_workers_ of them.
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
 };
@@ -8,6 +8,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -49,6 +50,11 @@ template <typename Dtype>
 class Batch {
  public:
   Blob<Dtype> data_, label_;
+  // Set by layers that leave the transformation to Forward: the crops of
+  // DataTransformer::CropRaw that data_ is computed from, and their
+  // parameters, one row of 3 per item
+  shared_ptr<SyncedMemory> raw_data_;
+  Blob<int> raw_crops_;
 };
 
 template <typename Dtype>
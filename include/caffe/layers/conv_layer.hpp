@@ -58,8 +58,9 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *  - engine: convolution has CAFFE (matrix multiplication), CUDNN (library
+   *    kernels + stream parallelism), DIRECT (CPU loops without a column
+   *    buffer) and WINOGRAD (CPU minimal filtering for 3x3 kernels) engines.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -77,6 +78,11 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // Whether the weights or the bias differ from snapshot, a copy of both
+  // that is brought up to date. Engines that compute data from the weights,
+  // such as packed filters, redo it only when they change.
+  bool weights_changed(Blob<Dtype>* snapshot);
 };
 
 }  // namespace caffe
@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYER_HPP_
 #define CAFFE_DATA_LAYER_HPP_
 
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -28,13 +29,25 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int MaxTopBlobs() const { return 2; }
 
  protected:
-  void Next();
-  bool Skip();
+  // Moves the cursor of a reader back to the start of its shard
+  void RewindShard(int reader);
+  // Reads up to n records of the shard of a reader, fewer at its end,
+  // rewinding it first if it is exhausted
+  void ReadShard(int reader, int n, vector<db::RecordView>* values);
   virtual void load_batch(Batch<Dtype>* batch);
 
   shared_ptr<db::DB> db_;
-  shared_ptr<db::Cursor> cursor_;
-  uint64_t offset_;
+  // The records are split into contiguous shards, one per reader of every
+  // solver. Each reader of this solver has its own cursor and transformer,
+  // the first one being the layer's data_transformer_, and never leaves
+  // its shard.
+  vector<shared_ptr<db::Cursor> > cursors_;
+  vector<shared_ptr<DataTransformer<Dtype> > > reader_transformers_;
+  // Key of the first record of each shard
+  vector<string> shard_begin_;
+  vector<int64_t> shard_size_;
+  // Records of each shard read since it was last rewound
+  vector<int64_t> shard_offset_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,76 @@
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct CPU implementation of ConvolutionLayer for depthwise and
+ *        narrow grouped convolutions.
+ *        Falls back to ConvolutionLayer for backward, GPU mode and
+ *        convolutions that are not 2D.
+ *
+ * The forward pass convolves a zero-padded copy of the input of one image
+ * instead of unrolling it with im2col, so it needs no column buffer, which is
+ * kernel size times larger than the input. Each output channel is computed a
+ * few pixels of a row at a time, whose accumulators are vectorized by the
+ * compiler along the pixels, straight from the weights of the layer. The
+ * padded input lives in the workspace of the layer, which holds the column
+ * buffers too only in the TRAIN phase, for backward.
+ *
+ * The per-group GEMMs of the CAFFE engine are too small to pay off when the
+ * groups have few output channels, such as depthwise ones. On dense layers a
+ * tuned BLAS is several times faster, so the layer factory takes the engine
+ * only for groups of fewer than kMaxGroupOutputs output channels. Compare the
+ * engines on the target machine with tools/convolution_benchmark.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), direct_(false),
+        padded_workspace_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline size_t WorkspaceSize() const {
+    if (!direct_) {
+      return ConvolutionLayer<Dtype>::WorkspaceSize();
+    }
+    if (this->phase_ == TEST) {
+      return padded_workspace_;
+    }
+    return std::max(ConvolutionLayer<Dtype>::WorkspaceSize(),
+        padded_workspace_);
+  }
+  virtual void SetWorkspace(const shared_ptr<SyncedMemory>& workspace);
+
+  /// Groups with this many output channels or more are left to CAFFE.
+  static const int kMaxGroupOutputs = 8;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // Copies the channels of one image into padded_input_.
+  void pad_input(const Dtype* input);
+
+  /// Whether the forward pass is direct, i.e. 2D in CPU mode.
+  bool direct_;
+  size_t padded_workspace_;
+  /// The padded input of one image, in the workspace.
+  Blob<Dtype> padded_input_;
+  int padded_height_, padded_width_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
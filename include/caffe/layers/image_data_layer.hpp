@@ -1,8 +1,6 @@
 #ifndef CAFFE_IMAGE_DATA_LAYER_HPP_
 #define CAFFE_IMAGE_DATA_LAYER_HPP_
 
-#include <string>
-#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -11,6 +9,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_list.hpp"
 
 namespace caffe {
 
@@ -37,8 +36,13 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
 
-  vector<std::pair<std::string, int> > lines_;
+  ImageList lines_;
+  // Shuffling permutes these indices into lines_, not the list itself
+  vector<int> line_order_;
   int lines_id_;
+  // One transformer per decode worker, each with its own random stream;
+  // the first one is the layer's data_transformer_.
+  vector<shared_ptr<DataTransformer<Dtype> > > decode_transformers_;
 };
 
 
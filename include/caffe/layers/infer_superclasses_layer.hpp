@@ -10,6 +10,11 @@
 
 namespace caffe {
 
+/**
+ * @brief Sums the scores of the fine classes of every coarse class, using the
+ *        mapping file of MapLabelsLayer. The reduction is a GEMM with a 0/1
+ *        (coarse x fine) matrix per image.
+ */
 template <typename Dtype>
 class InferSuperclassesLayer : public MapLabelsLayer<Dtype> {
  public:
@@ -30,12 +35,15 @@ class InferSuperclassesLayer : public MapLabelsLayer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  /*virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);*/
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  /*virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);*/
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// (coarse x fine) 0/1 matrix, 1 where the fine class belongs to the coarse
+  Blob<Dtype> superclass_matrix_;
 };
 
 }  // namespace caffe
@@ -9,6 +9,17 @@
 
 namespace caffe {
 
+/**
+ * @brief Maps fine labels to coarse labels with the mapping read from
+ *        map_labels_param.mapping_file (one line of fine labels per coarse
+ *        label).
+ *
+ * The mapping is compiled at setup into a dense table indexed by the fine
+ * label, padded to a power of two. Labels the file does not map, negative
+ * labels and labels past the table all map to map_labels_param.ignore_label,
+ * which must not be a coarse label when it is set. If the default (255) is a
+ * coarse label, they map to -1 instead.
+ */
 template <typename Dtype>
 class MapLabelsLayer : public Layer<Dtype> {
  public:
@@ -29,13 +40,18 @@ class MapLabelsLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  /*virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);*/
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
- 
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
   vector< vector<int> > coarse_to_fine_mapping_;
+  /// coarse label of every fine label up to the largest one, -1 if unmapped
   vector<int> fine_to_coarse_mapping_;
+  /// fine -> coarse lookup table; its last entry is always ignore_label
+  Blob<Dtype> label_table_;
 };
 
 }  // namespace caffe
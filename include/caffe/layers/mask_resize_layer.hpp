@@ -9,6 +9,8 @@
 #ifndef CAFFE_MASK_RESIZE_LAYERS_HPP_
 #define CAFFE_MASK_RESIZE_LAYERS_HPP_
 
+#include <vector>
+
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
@@ -42,6 +44,17 @@ class MaskResizeLayer : public Layer<Dtype> {
     int output_channels_;
     int output_height_;
     int output_width_;
+
+    /// Bilinear taps of every output row and column, shared by all masks.
+    /// A negative low index marks a sample that falls outside the input.
+    void ComputeTaps(const int input_size, const int output_size,
+        vector<int>* low, vector<int>* high, vector<Dtype>* frac);
+    vector<int> row_low_;
+    vector<int> row_high_;
+    vector<Dtype> row_frac_;
+    vector<int> col_low_;
+    vector<int> col_high_;
+    vector<Dtype> col_frac_;
 };
 
 }
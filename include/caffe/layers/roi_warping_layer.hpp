@@ -53,6 +53,8 @@ class ROIWarpingLayer : public Layer<Dtype> {
   Blob<Dtype> max_idx_h_;
   Blob<Dtype> max_idx_w_;
   Blob<Dtype> buffer_;
+  /// per-thread accumulators for the CPU backward pass to the feature map
+  Blob<Dtype> thread_diff_;
 };
 
 }  // namespace caffe
@@ -7,11 +7,18 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
+class FHArena;
+class FastSLIC;
+
 namespace caffe {
 
   /**
   * @brief Segment the image into a batch of segments
   *
+  * top[0] holds one [image x1 y1 x2 y2] box per segment and is resized
+  * every forward pass to the number of segments actually found (at most
+  * max_segments per image, the largest by area, when that is set).
+  *
   * TODO(dox): thorough documentation for Forward, Backward, and proto params.
   */
   template <typename Dtype>
@@ -47,10 +54,13 @@ namespace caffe {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 #endif
 
-    int Segmentation(std::vector<cv::Mat> &in, cv::Mat &out, const int segStartNumber = 0);
+    int Segmentation(std::vector<cv::Mat> &in, cv::Mat &out, const float k,
+      const int segStartNumber = 0);
 
     //Generic segmentation variables
-    int num_segments_;
+    int num_segments_;  // segments found by the last forward pass
+    int max_segments_;  // per image cap, 0 = keep all
+    Blob<int> seg_ids_;  // per image segment ids written by the backends
     int bbox_extension_;
     int method_;
 
@@ -58,11 +68,16 @@ namespace caffe {
     float smoothing_;
     float k_, min_k_, max_k_;
     int min_size_;
+    // graph and sort buffers reused across images, one per thread
+    vector<shared_ptr<FHArena> > fh_arenas_;
 
-    //Method = 1 = SLIC
+    //Method = 1 = SLIC, 2 = fast SLIC
     int s_;
     int m_;
     int iter_;
+    float min_center_shift_;
+    vector<shared_ptr<FastSLIC> > slic_engines_;
+    int slic_threads_;  // threads FastSLIC spreads one image over
   };
 
 }  // namespace caffe
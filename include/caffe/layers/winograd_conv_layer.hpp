@@ -0,0 +1,72 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd implementation of ConvolutionLayer for 2D 3x3 kernels
+ *        with stride and dilation 1.
+ *        Falls back to ConvolutionLayer for other shapes, backward and
+ *        GPU mode.
+ *
+ * Minimal filtering F(m x m, 3 x 3) computes each m x m tile of the output
+ * from an (m + 2) x (m + 2) tile of the input with (m + 2)^2 multiplications
+ * per channel pair instead of 9 m^2. The input tiles and the filters are
+ * transformed, the transformed inputs of every channel are combined with the
+ * transformed filters by one GEMM per element of the tile, and the results
+ * are transformed back. m is 4, or 2 for outputs smaller than 8 pixels,
+ * where F(4 x 4, 3 x 3) would mostly compute padding; it is less accurate
+ * than F(2 x 2, 3 x 3), with errors in the order of 1e-5 relative in float.
+ *
+ * The filters are transformed once and again only after the weights change,
+ * e.g. when they are loaded or shared with another net. The transformed
+ * inputs and outputs of one image live in the workspace of the layer.
+ * Layers with few input channels or depthwise groups gain little from the
+ * smaller GEMMs and may be faster with the CAFFE engine; compare them with
+ * tools/convolution_benchmark.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), tile_(0), winograd_workspace_(0),
+        transformed_tile_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline size_t WorkspaceSize() const {
+    return std::max(ConvolutionLayer<Dtype>::WorkspaceSize(),
+        winograd_workspace_);
+  }
+  /// @brief The output tile size m, or 0 if the layer falls back to im2col.
+  inline int tile() const { return tile_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // Transforms the filters, unless they are unchanged since the last call.
+  void transform_weights();
+
+  int tile_;
+  size_t winograd_workspace_;
+  /// The filters transformed for tile_, shaped group x (m + 2)^2 x
+  /// (num_output / group) x (channels / group).
+  Blob<Dtype> transformed_weights_;
+  /// The weights and bias that transformed_weights_ was computed from.
+  Blob<Dtype> weight_snapshot_;
+  int transformed_tile_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
@@ -78,7 +78,8 @@ class Net {
    * @brief Reshape all layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size. With
+   * share_activations, the blobs are planned again for the new sizes.
    */
   void Reshape();
 
@@ -98,6 +99,13 @@ class Net {
    * called manually.
    */
   void ShareWeights();
+  /**
+   * @brief Lends all layers one workspace of the largest WorkspaceSize().
+   *
+   * Note: this is called by Net::Init and Net::Reshape, and thus should
+   * normally not be called manually.
+   */
+  void ShareWorkspace();
 
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
@@ -133,6 +141,10 @@ class Net {
   inline const vector<shared_ptr<Layer<Dtype> > >& layers() const {
     return layers_;
   }
+  /// @brief returns the workspace lent to the layers, if any
+  inline const shared_ptr<SyncedMemory>& workspace() const {
+    return workspace_;
+  }
   /// @brief returns the phase: TRAIN or TEST
   inline Phase phase() const { return phase_; }
   /**
@@ -265,6 +277,19 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /**
+   * @brief Place the intermediate blobs in memory arenas shared by blobs
+   *        whose lifetimes do not overlap.
+   *
+   * A blob lives from the first to the last layer that has it as a bottom or
+   * top, so in-place layers extend the lifetime of their blob. Blobs that a
+   * layer made share memory, like the tops of split layers, are planned as
+   * one. The inputs and outputs of the net, the tops of layers without
+   * bottoms, and loss blobs keep their own memory.
+   */
+  void PlanActivations();
+  /// @brief Give the blobs placed by PlanActivations their own memory.
+  void ReleaseActivations();
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -328,6 +353,12 @@ class Net {
   vector<bool> has_params_decay_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// The scratch memory shared by the layers, see ShareWorkspace.
+  shared_ptr<SyncedMemory> workspace_;
+  /// Whether intermediate blobs share memory, see PlanActivations.
+  bool share_activations_;
+  /// The blobs placed in shared memory by the last PlanActivations.
+  vector<int> shared_blob_ids_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   // Callbacks
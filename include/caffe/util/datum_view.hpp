@@ -0,0 +1,51 @@
+#ifndef CAFFE_UTIL_DATUM_VIEW_HPP_
+#define CAFFE_UTIL_DATUM_VIEW_HPP_
+
+#include <stdint.h>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief The fields of a Datum, with the pixels left where they are.
+ *
+ * A view parsed from a serialized record by ParseDatumView() points into the
+ * record, so that raw uint8 pixels go from the database page to the
+ * transformer without being copied into a Datum first. A view built from a
+ * Datum points into that Datum. Either way the view is only valid as long as
+ * the memory it was made from.
+ */
+struct DatumView {
+  DatumView()
+      : channels(0), height(0), width(0), label(0), data(NULL), size(0),
+        float_data(NULL), encoded(false) {}
+  explicit DatumView(const Datum& datum)
+      : channels(datum.channels()), height(datum.height()),
+        width(datum.width()), label(datum.label()),
+        data(reinterpret_cast<const uint8_t*>(datum.data().data())),
+        size(datum.data().size()),
+        float_data(datum.float_data_size() ? datum.float_data().data() : NULL),
+        encoded(datum.encoded()) {}
+
+  int channels;
+  int height;
+  int width;
+  int label;
+  // The data field: raw pixels, or the image file if encoded
+  const uint8_t* data;
+  size_t size;
+  // The float_data field, used when data is empty
+  const float* float_data;
+  bool encoded;
+};
+
+// Parses a serialized Datum into a view of its data field. Returns false if
+// the record is malformed or has float_data, which is not stored contiguously
+// in the record; such records have to be parsed into a Datum.
+bool ParseDatumView(const char* buffer, size_t size, DatumView* view);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATUM_VIEW_HPP_
@@ -2,6 +2,7 @@
 #define CAFFE_UTIL_DB_HPP
 
 #include <string>
+#include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -10,16 +11,40 @@ namespace caffe { namespace db {
 
 enum Mode { READ, WRITE, NEW };
 
+// A value that stays owned by the cursor it was read from
+struct RecordView {
+  const char* data;
+  size_t size;
+};
+
 class Cursor {
  public:
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  // Moves to the first record whose key is not less than key
+  virtual void Seek(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
   virtual bool valid() = 0;
 
+  // Reads the values of up to n records from the current one on and moves
+  // the cursor past them. Returns the number read, which is less than n
+  // only at the end of the database. The views stay valid at least until
+  // the cursor is moved again. This version copies every value into the
+  // cursor; backends that can point into their own storage override it.
+  virtual int ReadBatch(int n, vector<RecordView>* values);
+  // Starts warming up to the given number of records ahead of the cursor
+  // in the background. The readahead covers span records from the current
+  // one on, or the rest of the database if span is 0, and then wraps back
+  // to the current record, as a reader confined to that range does. Does
+  // nothing for backends that gain nothing by it.
+  virtual void StartReadahead(int records, int64_t span) { }
+
+ protected:
+  vector<string> batch_values_;
+
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
 
@@ -41,6 +66,9 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  // Number of records. This version walks a cursor over the whole database;
+  // backends that keep count override it.
+  virtual int64_t Count();
 
   DISABLE_COPY_AND_ASSIGN(DB);
 };
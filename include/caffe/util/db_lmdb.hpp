@@ -15,18 +15,23 @@ inline void MDB_CHECK(int mdb_status) {
   CHECK_EQ(mdb_status, MDB_SUCCESS) << mdb_strerror(mdb_status);
 }
 
+class LMDBReadahead;
+
+/**
+ * The cursor keeps its read-only transaction open for its whole life, so
+ * the views returned by ReadBatch point straight into the memory map and
+ * stay valid as long as the cursor.
+ */
 class LMDBCursor : public Cursor {
  public:
   explicit LMDBCursor(MDB_txn* mdb_txn, MDB_cursor* mdb_cursor)
     : mdb_txn_(mdb_txn), mdb_cursor_(mdb_cursor), valid_(false) {
     SeekToFirst();
   }
-  virtual ~LMDBCursor() {
-    mdb_cursor_close(mdb_cursor_);
-    mdb_txn_abort(mdb_txn_);
-  }
-  virtual void SeekToFirst() { Seek(MDB_FIRST); }
-  virtual void Next() { Seek(MDB_NEXT); }
+  virtual ~LMDBCursor();
+  virtual void SeekToFirst();
+  virtual void Seek(const string& key);
+  virtual void Next();
   virtual string key() {
     return string(static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
   }
@@ -35,6 +40,8 @@ class LMDBCursor : public Cursor {
         mdb_value_.mv_size);
   }
   virtual bool valid() { return valid_; }
+  virtual int ReadBatch(int n, vector<RecordView>* values);
+  virtual void StartReadahead(int records, int64_t span);
 
  private:
   void Seek(MDB_cursor_op op) {
@@ -51,6 +58,7 @@ class LMDBCursor : public Cursor {
   MDB_cursor* mdb_cursor_;
   MDB_val mdb_key_, mdb_value_;
   bool valid_;
+  shared_ptr<LMDBReadahead> readahead_;
 };
 
 class LMDBTransaction : public Transaction {
@@ -83,6 +91,7 @@ class LMDB : public DB {
   }
   virtual LMDBCursor* NewCursor();
   virtual LMDBTransaction* NewTransaction();
+  virtual int64_t Count();
 
  private:
   MDB_env* mdb_env_;
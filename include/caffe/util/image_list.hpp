@@ -0,0 +1,86 @@
+#ifndef CAFFE_UTIL_IMAGE_LIST_HPP_
+#define CAFFE_UTIL_IMAGE_LIST_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// Layout of a binary image list, as written by WriteImageList():
+//
+//   ImageListHeader
+//   ImageListEntry[num_entries]
+//   char pool[pool_size]    the file names, back to back, no terminators
+//
+// Integers are stored in host byte order.
+struct ImageListHeader {
+  char magic[8];  // "CAFFEIML"
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_entries;
+  uint64_t pool_size;
+};
+
+struct ImageListEntry {
+  uint64_t offset;  // of the file name in the pool
+  uint32_t length;
+  int32_t label;
+};
+
+/**
+ * @brief A read-only list of (file name, label) pairs, the source of the
+ *        image data layers.
+ *
+ * Open() accepts the usual text list, one "name label" line per image where
+ * the label is the last field and the name may contain spaces, as well as
+ * the binary format above (see tools/convert_image_list.cpp). A text line
+ * whose last field is not an integer is an error. Binary lists
+ * are memory-mapped rather than parsed, so opening one costs next to nothing
+ * and processes reading the same list share its pages. Text lists are parsed
+ * into the same compact layout: one string pool plus an entry per line.
+ */
+class ImageList {
+ public:
+  ImageList();
+  ~ImageList();
+
+  void Open(const string& source);
+  void Close();
+
+  inline size_t size() const { return num_entries_; }
+  inline bool empty() const { return num_entries_ == 0; }
+  inline string name(size_t i) const {
+    return string(pool_ + entries_[i].offset, entries_[i].length);
+  }
+  inline int label(size_t i) const { return entries_[i].label; }
+  // Whether the list is a memory-mapped binary list
+  inline bool mapped() const { return map_ != NULL; }
+
+ protected:
+  void ParseText(const string& source);
+  void Map(const string& source);
+
+  const ImageListEntry* entries_;
+  const char* pool_;
+  size_t num_entries_;
+  size_t pool_size_;
+  vector<ImageListEntry> text_entries_;
+  vector<char> text_pool_;
+  void* map_;
+  size_t map_size_;
+
+  friend void WriteImageList(const ImageList& list, const string& filename);
+
+  DISABLE_COPY_AND_ASSIGN(ImageList);
+};
+
+// Stores a list in the binary format
+void WriteImageList(const ImageList& list, const string& filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_LIST_HPP_
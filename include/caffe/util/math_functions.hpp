@@ -25,6 +25,21 @@ void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
     Dtype* y);
 
+// Keeps BLAS on one thread while in scope, around code whose own threads
+// each call BLAS on their share of the work. MKL and OpenBLAS are told so;
+// ATLAS fixes its threads when it is built.
+class BlasSingleThread {
+ public:
+  explicit BlasSingleThread(bool enable = true);
+  ~BlasSingleThread();
+
+ private:
+  // The threads to restore, 0 if they were not changed
+  int threads_;
+
+  DISABLE_COPY_AND_ASSIGN(BlasSingleThread);
+};
+
 template <typename Dtype>
 void caffe_axpy(const int N, const Dtype alpha, const Dtype* X,
     Dtype* Y);
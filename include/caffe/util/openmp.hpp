@@ -0,0 +1,41 @@
+#ifndef CAFFE_UTIL_OPENMP_HPP_
+#define CAFFE_UTIL_OPENMP_HPP_
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace caffe {
+
+// Thin wrappers around the OpenMP runtime so that CPU layers can size and
+// index per-thread scratch space without sprinkling #ifdef _OPENMP around.
+// Without OpenMP (USE_OPENMP off) every parallel loop runs on one thread.
+
+inline int caffe_omp_max_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// The size of the current team; 1 outside a parallel region.
+inline int caffe_omp_num_threads() {
+#ifdef _OPENMP
+  return omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+inline int caffe_omp_thread_num() {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_OPENMP_HPP_
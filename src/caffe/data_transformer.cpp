@@ -2,6 +2,7 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,88 @@
 
 namespace caffe {
 
+// The fused transform kernels below crop, mirror, subtract the mean and
+// scale in a single pass. The choice of mirror and mean is made once per
+// image by instantiation, so the inner loops are free of branches and the
+// compiler vectorizes them.
+enum TransformMean { NO_MEAN, MEAN_VALUES, MEAN_FILE };
+
+template <typename Dtype>
+struct TransformKernelArgs {
+  // Distances between the channels, rows and pixels of the source
+  int src_channel_step, src_row_step, src_pixel_step;
+  // Mean at the first pixel of the crop, laid out like a datum
+  const Dtype* mean;
+  int mean_channel_step, mean_row_step;
+  // One mean value per channel
+  const Dtype* mean_values;
+  Dtype scale;
+  // Shape of the crop, which goes to dst as channels x height x width
+  int channels, height, width;
+  Dtype* dst;
+};
+
+template <typename Dtype, typename Src, bool kMirror, TransformMean kMean>
+inline void TransformRow(const Src* src, const int src_step,
+    const Dtype* mean, const Dtype mean_value, const Dtype scale,
+    const int width, Dtype* dst) {
+  if (kMirror) {
+    dst += width - 1;
+  }
+  for (int w = 0; w < width; ++w) {
+    Dtype pixel = static_cast<Dtype>(src[w * src_step]);
+    if (kMean == MEAN_FILE) {
+      pixel -= mean[w];
+    } else if (kMean == MEAN_VALUES) {
+      pixel -= mean_value;
+    }
+    dst[kMirror ? -w : w] = pixel * scale;
+  }
+}
+
+// Transforms the crop starting at src
+template <typename Dtype, typename Src, bool kMirror, TransformMean kMean>
+void TransformKernel(const Src* src_crop,
+    const TransformKernelArgs<Dtype>& args) {
+  for (int c = 0; c < args.channels; ++c) {
+    const Dtype mean_value = kMean == MEAN_VALUES ? args.mean_values[c] : 0;
+    for (int h = 0; h < args.height; ++h) {
+      const Src* src = src_crop + c * args.src_channel_step +
+          h * args.src_row_step;
+      const Dtype* mean = kMean == MEAN_FILE ? args.mean +
+          c * args.mean_channel_step + h * args.mean_row_step : NULL;
+      Dtype* dst = args.dst + (c * args.height + h) * args.width;
+      // Contiguous rows get a unit step the compiler can see
+      if (args.src_pixel_step == 1) {
+        TransformRow<Dtype, Src, kMirror, kMean>(src, 1, mean, mean_value,
+            args.scale, args.width, dst);
+      } else {
+        TransformRow<Dtype, Src, kMirror, kMean>(src, args.src_pixel_step,
+            mean, mean_value, args.scale, args.width, dst);
+      }
+    }
+  }
+}
+
+template <typename Dtype, typename Src>
+void RunTransformKernel(const Src* src_crop,
+    const TransformKernelArgs<Dtype>& args, const bool mirror,
+    const TransformMean mean) {
+  switch (mean) {
+  case NO_MEAN:
+    return mirror ? TransformKernel<Dtype, Src, true, NO_MEAN>(src_crop, args)
+        : TransformKernel<Dtype, Src, false, NO_MEAN>(src_crop, args);
+  case MEAN_VALUES:
+    return mirror ?
+        TransformKernel<Dtype, Src, true, MEAN_VALUES>(src_crop, args) :
+        TransformKernel<Dtype, Src, false, MEAN_VALUES>(src_crop, args);
+  case MEAN_FILE:
+    return mirror ?
+        TransformKernel<Dtype, Src, true, MEAN_FILE>(src_crop, args) :
+        TransformKernel<Dtype, Src, false, MEAN_FILE>(src_crop, args);
+  }
+}
+
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
     Phase phase)
@@ -39,32 +122,22 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
 }
 
 template<typename Dtype>
-void DataTransformer<Dtype>::Transform(const Datum& datum,
-                                       Dtype* transformed_data) {
-  const string& data = datum.data();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
-
+void DataTransformer<Dtype>::PickCrop(const int datum_channels,
+    const int datum_height, const int datum_width, int* h_off, int* w_off,
+    bool* do_mirror) {
   const int crop_size = param_.crop_size();
-  const Dtype scale = param_.scale();
-  const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
-  const bool has_mean_values = mean_values_.size() > 0;
+  *do_mirror = param_.mirror() && Rand(2);
 
   CHECK_GT(datum_channels, 0);
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
 
-  Dtype* mean = NULL;
-  if (has_mean_file) {
+  if (param_.has_mean_file()) {
     CHECK_EQ(datum_channels, data_mean_.channels());
     CHECK_EQ(datum_height, data_mean_.height());
     CHECK_EQ(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
   }
-  if (has_mean_values) {
+  if (mean_values_.size() > 0) {
     CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
      "Specify either 1 mean_value or as many as channels: " << datum_channels;
     if (datum_channels > 1 && mean_values_.size() == 1) {
@@ -75,58 +148,66 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
-  int height = datum_height;
-  int width = datum_width;
-
-  int h_off = 0;
-  int w_off = 0;
+  *h_off = 0;
+  *w_off = 0;
   if (crop_size) {
-    height = crop_size;
-    width = crop_size;
     // We only do random crop when we do training.
     if (phase_ == TRAIN) {
-      h_off = Rand(datum_height - crop_size + 1);
-      w_off = Rand(datum_width - crop_size + 1);
+      *h_off = Rand(datum_height - crop_size + 1);
+      *w_off = Rand(datum_width - crop_size + 1);
     } else {
-      h_off = (datum_height - crop_size) / 2;
-      w_off = (datum_width - crop_size) / 2;
+      *h_off = (datum_height - crop_size) / 2;
+      *w_off = (datum_width - crop_size) / 2;
     }
   }
+}
 
-  Dtype datum_element;
-  int top_index, data_index;
-  for (int c = 0; c < datum_channels; ++c) {
-    for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
-        }
-      }
-    }
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const DatumView& datum,
+                                       Dtype* transformed_data) {
+  const uint8_t* data = datum.data;
+  const int datum_channels = datum.channels;
+  const int datum_height = datum.height;
+  const int datum_width = datum.width;
+
+  const int crop_size = param_.crop_size();
+  const Dtype scale = param_.scale();
+  const bool has_mean_file = param_.has_mean_file();
+  const bool has_uint8 = datum.size > 0;
+  const bool has_mean_values = mean_values_.size() > 0;
+
+  int h_off, w_off;
+  bool do_mirror;
+  PickCrop(datum_channels, datum_height, datum_width, &h_off, &w_off,
+      &do_mirror);
+  const Dtype* mean = has_mean_file ? data_mean_.cpu_data() : NULL;
+  const int height = crop_size ? crop_size : datum_height;
+  const int width = crop_size ? crop_size : datum_width;
+
+  const int crop_offset = h_off * datum_width + w_off;
+  TransformKernelArgs<Dtype> args;
+  args.src_channel_step = datum_height * datum_width;
+  args.src_row_step = datum_width;
+  args.src_pixel_step = 1;
+  args.mean = has_mean_file ? mean + crop_offset : NULL;
+  args.mean_channel_step = datum_height * datum_width;
+  args.mean_row_step = datum_width;
+  args.mean_values = has_mean_values ? &mean_values_[0] : NULL;
+  args.scale = scale;
+  args.channels = datum_channels;
+  args.height = height;
+  args.width = width;
+  args.dst = transformed_data;
+  const TransformMean mean_mode = has_mean_file ? MEAN_FILE :
+      (has_mean_values ? MEAN_VALUES : NO_MEAN);
+  if (has_uint8) {
+    RunTransformKernel(data + crop_offset, args, do_mirror, mean_mode);
+  } else {
+    RunTransformKernel(datum.float_data + crop_offset, args, do_mirror,
+        mean_mode);
   }
 }
 
-
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
@@ -152,11 +233,22 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
       LOG(ERROR) << "force_color and force_gray only for encoded datum";
     }
   }
+  Transform(DatumView(datum), transformed_blob);
+}
 
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const DatumView& datum,
+                                       Blob<Dtype>* transformed_blob) {
+  CHECK(!datum.encoded) << "Encoded data has to be parsed into a Datum";
   const int crop_size = param_.crop_size();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  const int datum_channels = datum.channels;
+  const int datum_height = datum.height;
+  const int datum_width = datum.width;
+  if (datum.size > 0) {
+    CHECK_EQ(datum.size,
+        static_cast<size_t>(datum_channels) * datum_height * datum_width)
+        << "Datum data does not match its shape";
+  }
 
   // Check dimensions.
   const int channels = transformed_blob->channels();
@@ -181,6 +273,99 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   Transform(datum, transformed_data);
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::CropRaw(const DatumView& datum,
+                                     const Blob<Dtype>& transformed_blob,
+                                     uint8_t* raw_crop, int* crop) {
+  CHECK(!datum.encoded && datum.size > 0)
+      << "Only raw uint8 data can be cropped for TransformRaw";
+  const int crop_size = param_.crop_size();
+  const int datum_channels = datum.channels;
+  const int datum_height = datum.height;
+  const int datum_width = datum.width;
+  CHECK_EQ(datum.size,
+      static_cast<size_t>(datum_channels) * datum_height * datum_width)
+      << "Datum data does not match its shape";
+
+  // Check dimensions, the crop has to fill exactly its slot of the batch.
+  const int channels = transformed_blob.channels();
+  const int height = transformed_blob.height();
+  const int width = transformed_blob.width();
+  CHECK_EQ(channels, datum_channels);
+  CHECK_LE(height, datum_height);
+  CHECK_LE(width, datum_width);
+
+  if (crop_size) {
+    CHECK_EQ(crop_size, height);
+    CHECK_EQ(crop_size, width);
+  } else {
+    CHECK_EQ(datum_height, height);
+    CHECK_EQ(datum_width, width);
+  }
+
+  int h_off, w_off;
+  bool do_mirror;
+  PickCrop(datum_channels, datum_height, datum_width, &h_off, &w_off,
+      &do_mirror);
+  for (int c = 0; c < datum_channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      memcpy(raw_crop + (c * height + h) * width,
+          datum.data + (c * datum_height + h_off + h) * datum_width + w_off,
+          width);
+    }
+  }
+  crop[0] = h_off;
+  crop[1] = w_off;
+  crop[2] = do_mirror;
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw_cpu(const uint8_t* raw_crops,
+    const int* crops, Blob<Dtype>* transformed_blob) {
+  const int num = transformed_blob->num();
+  const int channels = transformed_blob->channels();
+  const int height = transformed_blob->height();
+  const int width = transformed_blob->width();
+  const bool has_mean_file = param_.has_mean_file();
+  const bool has_mean_values = mean_values_.size() > 0;
+  if (has_mean_values) {
+    CHECK_EQ(mean_values_.size(), channels)
+        << "TransformRaw needs the crops of CropRaw";
+  }
+  const Dtype* mean = has_mean_file ? data_mean_.cpu_data() : NULL;
+
+  TransformKernelArgs<Dtype> args;
+  args.src_channel_step = height * width;
+  args.src_row_step = width;
+  args.src_pixel_step = 1;
+  args.mean_channel_step = data_mean_.height() * data_mean_.width();
+  args.mean_row_step = data_mean_.width();
+  args.mean_values = has_mean_values ? &mean_values_[0] : NULL;
+  args.scale = param_.scale();
+  args.channels = channels;
+  args.height = height;
+  args.width = width;
+  const TransformMean mean_mode = has_mean_file ? MEAN_FILE :
+      (has_mean_values ? MEAN_VALUES : NO_MEAN);
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  for (int n = 0; n < num; ++n) {
+    const int* crop = crops + n * 3;
+    args.mean = has_mean_file ? mean + crop[0] * data_mean_.width() + crop[1]
+        : NULL;
+    args.dst = transformed_data + transformed_blob->offset(n);
+    RunTransformKernel(raw_crops + n * channels * height * width, args,
+        crop[2] != 0, mean_mode);
+  }
+}
+
+#ifdef CPU_ONLY
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw_gpu(const uint8_t* raw_crops,
+    const int* crops, Blob<Dtype>* transformed_blob) {
+  NO_GPU;
+}
+#endif
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
@@ -293,35 +478,24 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 
   CHECK(cv_cropped_img.data);
 
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
-  for (int h = 0; h < height; ++h) {
-    const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
-    }
-  }
+  // The image is stored row by row with interleaved channels
+  TransformKernelArgs<Dtype> args;
+  args.src_channel_step = 1;
+  args.src_row_step = cv_cropped_img.step[0];
+  args.src_pixel_step = img_channels;
+  args.mean = has_mean_file ? mean + h_off * img_width + w_off : NULL;
+  args.mean_channel_step = img_height * img_width;
+  args.mean_row_step = img_width;
+  args.mean_values = has_mean_values ? &mean_values_[0] : NULL;
+  args.scale = scale;
+  args.channels = img_channels;
+  args.height = height;
+  args.width = width;
+  args.dst = transformed_blob->mutable_cpu_data();
+  const TransformMean mean_mode = has_mean_file ? MEAN_FILE :
+      (has_mean_values ? MEAN_VALUES : NO_MEAN);
+  RunTransformKernel(cv_cropped_img.ptr<uchar>(0), args, do_mirror,
+      mean_mode);
 }
 #endif  // USE_OPENCV
 
@@ -457,10 +631,16 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
   }
+  return InferBlobShape(DatumView(datum));
+}
+
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::InferBlobShape(const DatumView& datum) {
+  CHECK(!datum.encoded) << "Encoded data has to be parsed into a Datum";
   const int crop_size = param_.crop_size();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  const int datum_channels = datum.channels;
+  const int datum_height = datum.height;
+  const int datum_width = datum.width;
   // Check dimensions.
   CHECK_GT(datum_channels, 0);
   CHECK_GE(datum_height, crop_size);
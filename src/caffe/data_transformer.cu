@@ -0,0 +1,69 @@
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/data_transformer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// One thread per output value. crops holds h_off, w_off and mirror per item;
+// mean, if given, is the whole mean image and mean_values, if given, one
+// value per channel.
+template <typename Dtype>
+__global__ void TransformRawKernel(const int nthreads,
+    const uint8_t* raw_crops, const int* crops, const Dtype* mean,
+    const int mean_height, const int mean_width, const Dtype* mean_values,
+    const Dtype scale, const int channels, const int height, const int width,
+    Dtype* transformed_data) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int w = index % width;
+    const int h = (index / width) % height;
+    const int c = (index / width / height) % channels;
+    const int n = index / width / height / channels;
+    const int* crop = crops + n * 3;
+    // Mirroring reads the crop from the right
+    const int src_w = crop[2] ? width - 1 - w : w;
+    Dtype pixel = raw_crops[((n * channels + c) * height + h) * width + src_w];
+    if (mean) {
+      pixel -= mean[(c * mean_height + crop[0] + h) * mean_width + crop[1] +
+          src_w];
+    } else if (mean_values) {
+      pixel -= mean_values[c];
+    }
+    transformed_data[index] = pixel * scale;
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw_gpu(const uint8_t* raw_crops,
+    const int* crops, Blob<Dtype>* transformed_blob) {
+  const int channels = transformed_blob->channels();
+  const bool has_mean_file = param_.has_mean_file();
+  const bool has_mean_values = mean_values_.size() > 0;
+  if (has_mean_values) {
+    CHECK_EQ(mean_values_.size(), channels)
+        << "TransformRaw needs the crops of CropRaw";
+    if (mean_values_blob_.count() != channels) {
+      mean_values_blob_.Reshape(vector<int>(1, channels));
+      caffe_copy(channels, &mean_values_[0],
+          mean_values_blob_.mutable_cpu_data());
+    }
+  }
+  const int count = transformed_blob->count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  TransformRawKernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+      CAFFE_CUDA_NUM_THREADS>>>(count, raw_crops, crops,
+      has_mean_file ? data_mean_.gpu_data() : NULL, data_mean_.height(),
+      data_mean_.width(), has_mean_values ? mean_values_blob_.gpu_data() : NULL,
+      Dtype(param_.scale()), channels, transformed_blob->height(),
+      transformed_blob->width(), transformed_blob->mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void DataTransformer<float>::TransformRaw_gpu(
+    const uint8_t* raw_crops, const int* crops, Blob<float>* transformed_blob);
+template void DataTransformer<double>::TransformRaw_gpu(
+    const uint8_t* raw_crops, const int* crops, Blob<double>* transformed_blob);
+
+}  // namespace caffe
@@ -226,9 +226,9 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       conv_input_shape_data[i] = bottom[0]->shape(channel_axis_ + i);
     }
   }
-  // The im2col result buffer will only hold one image at a time to avoid
-  // overly large memory usage. In the special case of 1x1 convolution
-  // it goes lazily unused to save memory.
+  // The im2col result buffer will only hold one image per CPU worker at a
+  // time to avoid overly large memory usage. In the special case of 1x1
+  // convolution it goes lazily unused to save memory.
   col_buffer_shape_.clear();
   col_buffer_shape_.push_back(kernel_dim_ * group_);
   for (int i = 0; i < num_spatial_axes_; ++i) {
@@ -239,6 +239,24 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   col_buffer_.Reshape(col_buffer_shape_);
+  // The CPU workers take one image each at a time, with a column buffer
+  // each. The buffers are the layer's workspace, which the net shares at the
+  // size of the largest, so there are no more workers than fit their buffers
+  // in kMaxWorkerWorkspace. Layers with larger buffers run the images one by
+  // one and leave the threads to BLAS.
+  num_workers_ = 1;
+  if (Caffe::mode() == Caffe::CPU) {
+    num_workers_ = std::min(num_, caffe_omp_max_threads());
+    if (!is_1x1_) {
+      num_workers_ = std::min<size_t>(num_workers_,
+          kMaxWorkerWorkspace / (col_buffer_.count() * sizeof(Dtype)));
+    }
+    num_workers_ = std::max(num_workers_, 1);
+  }
+  if (!is_1x1_ && col_buffer_.data()->size() < WorkspaceSize()) {
+    col_buffer_.ShareData(shared_ptr<SyncedMemory>(
+        new SyncedMemory(WorkspaceSize())));
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -253,20 +271,60 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::cpu_col_buffers() {
+  if (is_1x1_) {
+    return NULL;
+  }
+  // A subclass may leave the buffers out of its WorkspaceSize(), when it
+  // only needs them for backward.
+  const size_t size = BaseConvolutionLayer<Dtype>::WorkspaceSize();
+  if (col_buffer_.data()->size() < size) {
+    col_buffer_.ShareData(shared_ptr<SyncedMemory>(new SyncedMemory(size)));
+  }
+  return col_buffer_.mutable_cpu_data();
+}
+
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::worker_diffs(Blob<Dtype>* param,
+    Blob<Dtype>* buffer) {
+  if (num_workers_ == 1) {
+    return param->mutable_cpu_diff();
+  }
+  vector<int> buffer_shape(1, num_workers_);
+  buffer_shape.push_back(param->count());
+  buffer->Reshape(buffer_shape);
+  caffe_set(buffer->count(), Dtype(0), buffer->mutable_cpu_data());
+  return buffer->mutable_cpu_data();
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::reduce_worker_diffs(
+    const Blob<Dtype>& buffer, Blob<Dtype>* param) {
+  if (num_workers_ == 1) {
+    return;
+  }
+  // fixed summation order keeps the result independent of scheduling
+  const int count = param->count();
+  Dtype* diff = param->mutable_cpu_diff();
+  for (int worker = 0; worker < num_workers_; ++worker) {
+    caffe_axpy(count, Dtype(1), buffer.cpu_data() + worker * count, diff);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
-  const Dtype* col_buff = input;
+    const Dtype* weights, Dtype* output, Dtype* col_buff, bool skip_im2col) {
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buff);
     }
-    col_buff = col_buffer_.cpu_data();
+    input = col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
         group_, conv_out_spatial_dim_, kernel_dim_,
-        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+        (Dtype)1., weights + weight_offset_ * g, input + col_offset_ * g,
         (Dtype)0., output + output_offset_ * g);
   }
 }
@@ -281,8 +339,7 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+    const Dtype* weights, Dtype* input, Dtype* col_buff) {
   if (is_1x1_) {
     col_buff = input;
   }
@@ -299,16 +356,15 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
-  const Dtype* col_buff = input;
+    const Dtype* output, Dtype* weights, Dtype* col_buff) {
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    conv_im2col_cpu(input, col_buff);
+    input = col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
         kernel_dim_, conv_out_spatial_dim_,
-        (Dtype)1., output + output_offset_ * g, col_buff + col_offset_ * g,
+        (Dtype)1., output + output_offset_ * g, input + col_offset_ * g,
         (Dtype)1., weights + weight_offset_ * g);
   }
 }
@@ -58,6 +58,10 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     if (this->output_labels_) {
       prefetch_[i]->label_.mutable_cpu_data();
     }
+    if (prefetch_[i]->raw_data_) {
+      prefetch_[i]->raw_data_->mutable_cpu_data();
+      prefetch_[i]->raw_crops_.mutable_cpu_data();
+    }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
@@ -66,6 +70,10 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
       if (this->output_labels_) {
         prefetch_[i]->label_.mutable_gpu_data();
       }
+      if (prefetch_[i]->raw_data_) {
+        prefetch_[i]->raw_data_->mutable_gpu_data();
+        prefetch_[i]->raw_crops_.mutable_gpu_data();
+      }
     }
   }
 #endif
@@ -90,7 +98,13 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
-        batch->data_.data().get()->async_gpu_push(stream);
+        // Raw batches go as bytes, and are transformed on the device
+        if (batch->raw_data_) {
+          batch->raw_data_->async_gpu_push(stream);
+          batch->raw_crops_.data().get()->async_gpu_push(stream);
+        } else {
+          batch->data_.data().get()->async_gpu_push(stream);
+        }
         if (this->output_labels_) {
           batch->label_.data().get()->async_gpu_push(stream);
         }
@@ -116,6 +130,12 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     prefetch_free_.push(prefetch_current_);
   }
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  if (prefetch_current_->raw_data_) {
+    // Finish the transformation left by the prefetch thread
+    this->data_transformer_->TransformRaw_cpu(
+        static_cast<const uint8_t*>(prefetch_current_->raw_data_->cpu_data()),
+        prefetch_current_->raw_crops_.cpu_data(), &prefetch_current_->data_);
+  }
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
   top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
@@ -11,6 +11,12 @@ void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     prefetch_free_.push(prefetch_current_);
   }
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  if (prefetch_current_->raw_data_) {
+    // Finish the transformation left by the prefetch thread
+    this->data_transformer_->TransformRaw_gpu(
+        static_cast<const uint8_t*>(prefetch_current_->raw_data_->gpu_data()),
+        prefetch_current_->raw_crops_.gpu_data(), &prefetch_current_->data_);
+  }
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
   top[0]->set_gpu_data(prefetch_current_->data_.mutable_gpu_data());
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
@@ -21,18 +22,45 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::weights_changed(Blob<Dtype>* snapshot) {
+  const int weight_count = this->blobs_[0]->count();
+  const int bias_count = this->bias_term_ ? this->blobs_[1]->count() : 0;
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  // Compared bitwise, so that NaN weights do not count as changed each time
+  if (snapshot->count() == weight_count + bias_count &&
+      memcmp(snapshot->cpu_data(), weights, weight_count * sizeof(Dtype)) == 0
+      && (!this->bias_term_ || memcmp(snapshot->cpu_data() + weight_count,
+          this->blobs_[1]->cpu_data(), bias_count * sizeof(Dtype)) == 0)) {
+    return false;
+  }
+  snapshot->Reshape(vector<int>(1, weight_count + bias_count));
+  caffe_copy(weight_count, weights, snapshot->mutable_cpu_data());
+  if (this->bias_term_) {
+    caffe_copy(bias_count, this->blobs_[1]->cpu_data(),
+        snapshot->mutable_cpu_data() + weight_count);
+  }
+  return true;
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* col_buffers = this->cpu_col_buffers();
+  // The workers share out the images, so BLAS is not to add threads
+  BlasSingleThread blas_thread(this->num_workers_ > 1);
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(this->num_workers_)
+#endif
     for (int n = 0; n < this->num_; ++n) {
       this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
+          top_data + n * this->top_dim_, this->worker_col_buffer(col_buffers));
       if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
@@ -43,31 +71,54 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const bool bias_propagate_down =
+      this->bias_term_ && this->param_propagate_down_[1];
+  Dtype* col_buffers = this->cpu_col_buffers();
+  // The workers share out the images, so BLAS is not to add threads
+  BlasSingleThread blas_thread(this->num_workers_ > 1);
   for (int i = 0; i < top.size(); ++i) {
+    if (!bias_propagate_down && !this->param_propagate_down_[0] &&
+        !propagate_down[i]) {
+      continue;
+    }
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
-    // Bias gradient, if necessary.
-    if (this->bias_term_ && this->param_propagate_down_[1]) {
-      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
-      for (int n = 0; n < this->num_; ++n) {
-        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+    Dtype* weight_diffs = this->param_propagate_down_[0] ?
+        this->worker_diffs(this->blobs_[0].get(), &this->worker_weight_diff_) :
+        NULL;
+    Dtype* bias_diffs = bias_propagate_down ?
+        this->worker_diffs(this->blobs_[1].get(), &this->worker_bias_diff_) :
+        NULL;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(this->num_workers_)
+#endif
+    for (int n = 0; n < this->num_; ++n) {
+      Dtype* col_buff = this->worker_col_buffer(col_buffers);
+      // Bias gradient, if necessary.
+      if (bias_propagate_down) {
+        this->backward_cpu_bias(
+            this->worker_diff(bias_diffs, *this->blobs_[1]),
+            top_diff + n * this->top_dim_);
       }
-    }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
-        }
+      // gradient w.r.t. weight. Note that we will accumulate diffs.
+      if (this->param_propagate_down_[0]) {
+        this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_,
+            this->worker_diff(weight_diffs, *this->blobs_[0]), col_buff);
       }
+      // gradient w.r.t. bottom data, if necessary.
+      if (propagate_down[i]) {
+        this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_, col_buff);
+      }
+    }
+    if (this->param_propagate_down_[0]) {
+      this->reduce_worker_diffs(this->worker_weight_diff_,
+          this->blobs_[0].get());
+    }
+    if (bias_propagate_down) {
+      this->reduce_worker_diffs(this->worker_bias_diff_, this->blobs_[1].get());
     }
   }
 }
@@ -3,21 +3,22 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/datum_view.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
-  : BasePrefetchingDataLayer<Dtype>(param),
-    offset_() {
+  : BasePrefetchingDataLayer<Dtype>(param) {
   db_.reset(db::GetDB(param.data_param().backend()));
   db_->Open(param.data_param().source(), db::READ);
-  cursor_.reset(db_->NewCursor());
 }
 
 template <typename Dtype>
@@ -28,10 +29,61 @@ DataLayer<Dtype>::~DataLayer() {
 template <typename Dtype>
 void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const int batch_size = this->layer_param_.data_param().batch_size();
+  const DataParameter& data_param = this->layer_param_.data_param();
+  const int batch_size = data_param.batch_size();
+  // In test mode, only rank 0 runs, so it reads the whole database
+  const bool test = this->layer_param_.phase() == TEST;
+  const int solver_count = test ? 1 : Caffe::solver_count();
+  const int solver_rank = test ? 0 : Caffe::solver_rank();
+  CHECK_GT(data_param.readers(), 0) << "Positive number of readers required";
+  const int readers = std::min<int>(data_param.readers(), batch_size);
+  const int64_t num_shards = solver_count * readers;
+  const int64_t num_records = db_->Count();
+  CHECK_GE(num_records, num_shards) << "Fewer records than shards in "
+      << data_param.source();
+
+  // Walk the keys up to the shards of this solver to find where they begin
+  shared_ptr<db::Cursor> cursor(db_->NewCursor());
+  cursor->SeekToFirst();
+  int64_t index = 0;
+  shard_begin_.clear();
+  shard_size_.clear();
+  for (int reader = 0; reader < readers; ++reader) {
+    const int64_t shard = solver_rank * readers + reader;
+    const int64_t begin = num_records * shard / num_shards;
+    const int64_t end = num_records * (shard + 1) / num_shards;
+    for (; index < begin; ++index) {
+      cursor->Next();
+    }
+    CHECK(cursor->valid()) << "Fewer records than counted in "
+        << data_param.source();
+    shard_begin_.push_back(cursor->key());
+    shard_size_.push_back(end - begin);
+  }
+  cursor.reset();
+
+  cursors_.clear();
+  reader_transformers_.clear();
+  for (int reader = 0; reader < readers; ++reader) {
+    cursors_.push_back(shared_ptr<db::Cursor>(db_->NewCursor()));
+    cursors_[reader]->Seek(shard_begin_[reader]);
+    if (reader == 0) {
+      reader_transformers_.push_back(this->data_transformer_);
+    } else {
+      shared_ptr<DataTransformer<Dtype> > transformer(
+          new DataTransformer<Dtype>(this->transform_param_, this->phase_));
+      transformer->InitRand();
+      reader_transformers_.push_back(transformer);
+    }
+  }
+  shard_offset_.assign(readers, 0);
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Reading " << num_records << " records in " << num_shards
+      << " shards, " << readers << " per solver";
+
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
-  datum.ParseFromString(cursor_->value());
+  datum.ParseFromString(cursors_[0]->value());
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -41,6 +93,11 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   top[0]->Reshape(top_shape);
   for (int i = 0; i < this->prefetch_.size(); ++i) {
     this->prefetch_[i]->data_.Reshape(top_shape);
+    if (data_param.device_transform()) {
+      this->prefetch_[i]->raw_data_.reset(
+          new SyncedMemory(this->prefetch_[i]->data_.count()));
+      this->prefetch_[i]->raw_crops_.Reshape(batch_size, 3, 1, 1);
+    }
   }
   LOG_IF(INFO, Caffe::root_solver())
       << "output data size: " << top[0]->num() << ","
@@ -54,27 +111,30 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
+  for (int reader = 0; reader < readers; ++reader) {
+    cursors_[reader]->StartReadahead(data_param.readahead(),
+        shard_size_[reader]);
+  }
 }
 
 template <typename Dtype>
-bool DataLayer<Dtype>::Skip() {
-  int size = Caffe::solver_count();
-  int rank = Caffe::solver_rank();
-  bool keep = (offset_ % size) == rank ||
-              // In test mode, only rank 0 runs, so avoid skipping
-              this->layer_param_.phase() == TEST;
-  return !keep;
+void DataLayer<Dtype>::RewindShard(int reader) {
+  LOG_IF(INFO, Caffe::root_solver() && reader == 0)
+      << "Restarting data prefetching from start.";
+  cursors_[reader]->Seek(shard_begin_[reader]);
+  shard_offset_[reader] = 0;
 }
 
-template<typename Dtype>
-void DataLayer<Dtype>::Next() {
-  cursor_->Next();
-  if (!cursor_->valid()) {
-    LOG_IF(INFO, Caffe::root_solver())
-        << "Restarting data prefetching from start.";
-    cursor_->SeekToFirst();
+template <typename Dtype>
+void DataLayer<Dtype>::ReadShard(int reader, int n,
+    vector<db::RecordView>* values) {
+  if (shard_offset_[reader] == shard_size_[reader]) {
+    RewindShard(reader);
   }
-  offset_++;
+  n = std::min<int64_t>(n, shard_size_[reader] - shard_offset_[reader]);
+  CHECK_EQ(cursors_[reader]->ReadBatch(n, values), n)
+      << "Fewer records than counted in the database";
+  shard_offset_[reader] += n;
 }
 
 // This function is called on prefetch thread
@@ -88,40 +148,114 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
+  const bool device_transform =
+      this->layer_param_.data_param().device_transform();
 
-  Datum datum;
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    while (Skip()) {
-      Next();
-    }
-    datum.ParseFromString(cursor_->value());
-    read_time += timer.MicroSeconds();
-
-    if (item_id == 0) {
-      // Reshape according to the first datum of each batch
-      // on single input batches allows for inputs of varying dimension.
-      // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-      this->transformed_data_.Reshape(top_shape);
-      // Reshape batch according to the batch_size.
-      top_shape[0] = batch_size;
-      batch->data_.Reshape(top_shape);
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  // The first reader reads its first records here already, so that the
+  // shape comes from a view of the first one rather than a parsed copy.
+  const int num_readers = cursors_.size();
+  vector<vector<db::RecordView> > reader_values(num_readers);
+  timer.Start();
+  ReadShard(0, batch_size / num_readers, &reader_values[0]);
+  const db::RecordView& first = reader_values[0][0];
+  DatumView first_view;
+  vector<int> top_shape;
+  if (ParseDatumView(first.data, first.size, &first_view) &&
+      !first_view.encoded) {
+    top_shape = this->data_transformer_->InferBlobShape(first_view);
+  } else {
+    Datum first_datum;
+    first_datum.ParseFromArray(first.data, first.size);
+    top_shape = this->data_transformer_->InferBlobShape(first_datum);
+  }
+  read_time += timer.MicroSeconds();
+  this->transformed_data_.Reshape(top_shape);
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+  Dtype* top_data = NULL;
+  uint8_t* raw_data = NULL;
+  int* raw_crops = NULL;
+  if (device_transform) {
+    // Only the crops are made here, the transformation is finished by
+    // Forward from the bytes
+    if (batch->raw_data_->size() < batch->data_.count()) {
+      batch->raw_data_.reset(new SyncedMemory(batch->data_.count()));
     }
+    raw_data = static_cast<uint8_t*>(batch->raw_data_->mutable_cpu_data());
+    raw_crops = batch->raw_crops_.mutable_cpu_data();
+  } else {
+    top_data = batch->data_.mutable_cpu_data();
+  }
+  Dtype* top_label = this->output_labels_ ?
+      batch->label_.mutable_cpu_data() : NULL;
 
-    // Apply data transformations (mirror, scale, crop...)
-    timer.Start();
-    int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+  // Reader r fills items [r, r + 1) * batch_size / num_readers from its
+  // shard with its own transformer, whichever thread runs it.
+  vector<double> read_times(num_readers, 0);
+  vector<double> trans_times(num_readers, 0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads(num_readers)
+#endif
+  for (int reader = 0; reader < num_readers; ++reader) {
+    CPUTimer timer;
+    Blob<Dtype> transformed_data(this->transformed_data_.shape());
+    Datum datum;
+    DatumView view;
+    vector<db::RecordView>& values = reader_values[reader];
+    int item_id = batch_size * reader / num_readers;
+    const int end = batch_size * (reader + 1) / num_readers;
+    while (item_id < end) {
+      // Read the rest of the items at once, up to the end of the shard. The
+      // views point into the database where the backend allows it, and are
+      // used up before the cursor reads again.
+      if (values.empty()) {
+        timer.Start();
+        ReadShard(reader, end - item_id, &values);
+        read_times[reader] += timer.MicroSeconds();
+      }
+      const int n = values.size();
+      for (int i = 0; i < n; ++i, ++item_id) {
+        // Raw pixels are transformed right from the record through a view,
+        // other records are parsed into a Datum.
+        timer.Start();
+        const bool use_view =
+            ParseDatumView(values[i].data, values[i].size, &view) &&
+            !view.encoded && view.size > 0;
+        if (!use_view) {
+          datum.ParseFromArray(values[i].data, values[i].size);
+        }
+        read_times[reader] += timer.MicroSeconds();
+
+        // Apply data transformations (mirror, scale, crop...)
+        timer.Start();
+        if (device_transform) {
+          CHECK(use_view) << "device_transform needs raw uint8 data";
+          reader_transformers_[reader]->CropRaw(view, transformed_data,
+              raw_data + batch->data_.offset(item_id), raw_crops + item_id * 3);
+        } else if (use_view) {
+          transformed_data.set_cpu_data(
+              top_data + batch->data_.offset(item_id));
+          reader_transformers_[reader]->Transform(view, &transformed_data);
+        } else {
+          transformed_data.set_cpu_data(
+              top_data + batch->data_.offset(item_id));
+          reader_transformers_[reader]->Transform(datum, &transformed_data);
+        }
+        // Copy label.
+        if (top_label) {
+          top_label[item_id] = use_view ? view.label : datum.label();
+        }
+        trans_times[reader] += timer.MicroSeconds();
+      }
+      values.clear();
     }
-    trans_time += timer.MicroSeconds();
-    Next();
+  }
+  for (int reader = 0; reader < num_readers; ++reader) {
+    read_time += read_times[reader];
+    trans_time += trans_times[reader];
   }
   timer.Stop();
   batch_timer.Stop();
@@ -25,14 +25,20 @@ template <typename Dtype>
 void DeconvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* col_buffers = this->cpu_col_buffers();
+  // The workers share out the images, so BLAS is not to add threads
+  BlasSingleThread blas_thread(this->num_workers_ > 1);
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(this->num_workers_)
+#endif
     for (int n = 0; n < this->num_; ++n) {
       this->backward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
+          top_data + n * this->top_dim_, this->worker_col_buffer(col_buffers));
       if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
@@ -43,34 +49,57 @@ template <typename Dtype>
 void DeconvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const bool bias_propagate_down =
+      this->bias_term_ && this->param_propagate_down_[1];
+  Dtype* col_buffers = this->cpu_col_buffers();
+  // The workers share out the images, so BLAS is not to add threads
+  BlasSingleThread blas_thread(this->num_workers_ > 1);
   for (int i = 0; i < top.size(); ++i) {
+    if (!bias_propagate_down && !this->param_propagate_down_[0] &&
+        !propagate_down[i]) {
+      continue;
+    }
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
-    // Bias gradient, if necessary.
-    if (this->bias_term_ && this->param_propagate_down_[1]) {
-      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
-      for (int n = 0; n < this->num_; ++n) {
-        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+    Dtype* weight_diffs = this->param_propagate_down_[0] ?
+        this->worker_diffs(this->blobs_[0].get(), &this->worker_weight_diff_) :
+        NULL;
+    Dtype* bias_diffs = bias_propagate_down ?
+        this->worker_diffs(this->blobs_[1].get(), &this->worker_bias_diff_) :
+        NULL;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(this->num_workers_)
+#endif
+    for (int n = 0; n < this->num_; ++n) {
+      Dtype* col_buff = this->worker_col_buffer(col_buffers);
+      // Bias gradient, if necessary.
+      if (bias_propagate_down) {
+        this->backward_cpu_bias(
+            this->worker_diff(bias_diffs, *this->blobs_[1]),
+            top_diff + n * this->top_dim_);
       }
-    }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // Gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(top_diff + n * this->top_dim_,
-              bottom_data + n * this->bottom_dim_, weight_diff);
-        }
-        // Gradient w.r.t. bottom data, if necessary, reusing the column buffer
-        // we might have just computed above.
-        if (propagate_down[i]) {
-          this->forward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_,
-              this->param_propagate_down_[0]);
-        }
+      // Gradient w.r.t. weight. Note that we will accumulate diffs.
+      if (this->param_propagate_down_[0]) {
+        this->weight_cpu_gemm(top_diff + n * this->top_dim_,
+            bottom_data + n * this->bottom_dim_,
+            this->worker_diff(weight_diffs, *this->blobs_[0]), col_buff);
+      }
+      // Gradient w.r.t. bottom data, if necessary, reusing the column buffer
+      // we might have just computed above.
+      if (propagate_down[i]) {
+        this->forward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_, col_buff,
+            this->param_propagate_down_[0]);
       }
     }
+    if (this->param_propagate_down_[0]) {
+      this->reduce_worker_diffs(this->worker_weight_diff_,
+          this->blobs_[0].get());
+    }
+    if (bias_propagate_down) {
+      this->reduce_worker_diffs(this->worker_bias_diff_, this->blobs_[1].get());
+    }
   }
 }
 
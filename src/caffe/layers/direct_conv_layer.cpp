@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Each output channel is computed kRowTile pixels of a row at a time.
+static const int kRowTile = 8;
+
+// Computes kRowTile pixels of a row of one output channel. input points at
+// the padded input of the first pixel and weights at the filter of the
+// channel. The accumulators run along the pixels, a vector of them per step
+// of the filter.
+template <typename Dtype, bool kUnitStride>
+inline void direct_conv_row(const Dtype* input, const Dtype* weights,
+    const int channels, const int input_channel_dim, const int input_width,
+    const int kernel_h, const int kernel_w, const int dilation_h,
+    const int dilation_w, const int stride_w, const Dtype bias,
+    const int output_pixels, Dtype* output) {
+  const int stride = kUnitStride ? 1 : stride_w;
+  Dtype acc[kRowTile];
+  for (int j = 0; j < kRowTile; ++j) {
+    acc[j] = bias;
+  }
+  for (int c = 0; c < channels; ++c) {
+    for (int kh = 0; kh < kernel_h; ++kh) {
+      const Dtype* input_row =
+          input + c * input_channel_dim + kh * dilation_h * input_width;
+      for (int kw = 0; kw < kernel_w; ++kw) {
+        const Dtype* x = input_row + kw * dilation_w;
+        const Dtype w = *weights++;
+        for (int j = 0; j < kRowTile; ++j) {
+          acc[j] += w * x[j * stride];
+        }
+      }
+    }
+  }
+  for (int j = 0; j < output_pixels; ++j) {
+    output[j] = acc[j];
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  // The padded input is sized before the base class sizes the workspace.
+  direct_ = this->num_spatial_axes_ == 2 && Caffe::mode() == Caffe::CPU;
+  padded_workspace_ = 0;
+  if (direct_) {
+    const int* kernel_shape = this->kernel_shape_.cpu_data();
+    const int* stride = this->stride_.cpu_data();
+    const int* pad = this->pad_.cpu_data();
+    const int* dilation = this->dilation_.cpu_data();
+    const int height = bottom[0]->shape(this->channel_axis_ + 1);
+    const int width = bottom[0]->shape(this->channel_axis_ + 2);
+    const int output_w = (width + 2 * pad[1] -
+        ((kernel_shape[1] - 1) * dilation[1] + 1)) / stride[1] + 1;
+    // The padding covers the input of whole row tiles, so that no tile needs
+    // bounds checks and the last tile of a row reads zeros beyond the image.
+    const int tiles_w = (output_w + kRowTile - 1) / kRowTile;
+    padded_height_ = height + 2 * pad[0];
+    padded_width_ = std::max(width + 2 * pad[1],
+        (tiles_w * kRowTile - 1) * stride[1] +
+        (kernel_shape[1] - 1) * dilation[1] + 1);
+    vector<int> padded_shape(3);
+    padded_shape[0] = this->channels_;
+    padded_shape[1] = padded_height_;
+    padded_shape[2] = padded_width_;
+    padded_input_.Reshape(padded_shape);
+    padded_workspace_ = padded_input_.count() * sizeof(Dtype);
+  }
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::SetWorkspace(
+    const shared_ptr<SyncedMemory>& workspace) {
+  // The column buffers are left out of the workspace of a TEST layer.
+  if (workspace->size() >= ConvolutionLayer<Dtype>::WorkspaceSize()) {
+    ConvolutionLayer<Dtype>::SetWorkspace(workspace);
+  }
+  if (direct_) {
+    padded_input_.ShareData(workspace);
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::pad_input(const Dtype* input) {
+  const int* pad = this->pad_.cpu_data();
+  const int channels = this->channels_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  Dtype* padded = padded_input_.mutable_cpu_data();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int c = 0; c < channels; ++c) {
+    Dtype* padded_channel = padded + c * padded_height_ * padded_width_;
+    caffe_set(padded_height_ * padded_width_, Dtype(0), padded_channel);
+    for (int h = 0; h < height; ++h) {
+      caffe_copy(width, input + (c * height + h) * width,
+          padded_channel + (h + pad[0]) * padded_width_ + pad[1]);
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!direct_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int channels = this->channels_ / this->group_;
+  const int input_channel_dim = padded_height_ * padded_width_;
+  const int output_channels = this->num_output_ / this->group_;
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int output_channel_dim = output_h * output_w;
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const Dtype* padded = padded_input_.cpu_data();
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      pad_input(bottom_data + n * this->bottom_dim_);
+      // Each output row of each channel is a task, so that a single image
+      // keeps all threads busy.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+      for (int task = 0; task < this->num_output_ * output_h; ++task) {
+        const int oc = task / output_h;
+        const int oh = task % output_h;
+        const int g = oc / output_channels;
+        const Dtype* input_row = padded + g * channels * input_channel_dim +
+            oh * stride[0] * padded_width_;
+        const Dtype* filter = weights + oc * kernel_dim;
+        const Dtype channel_bias = bias ? bias[oc] : Dtype(0);
+        Dtype* output_row = top_data + n * this->top_dim_ +
+            oc * output_channel_dim + oh * output_w;
+        for (int ow = 0; ow < output_w; ow += kRowTile) {
+          const int row_pixels = std::min(kRowTile, output_w - ow);
+          if (stride[1] == 1) {
+            direct_conv_row<Dtype, true>(
+                input_row + ow, filter, channels, input_channel_dim,
+                padded_width_, kernel_shape[0], kernel_shape[1],
+                dilation[0], dilation[1], 1, channel_bias, row_pixels,
+                output_row + ow);
+          } else {
+            direct_conv_row<Dtype, false>(
+                input_row + ow * stride[1], filter, channels,
+                input_channel_dim, padded_width_, kernel_shape[0],
+                kernel_shape[1], dilation[0], dilation[1], stride[1],
+                channel_bias, row_pixels, output_row + ow);
+          }
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
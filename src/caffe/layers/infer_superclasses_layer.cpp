@@ -18,69 +18,62 @@ namespace caffe {
 	template <typename Dtype>
 	void InferSuperclassesLayer<Dtype>::Reshape(
 		const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-		//top[0]->ReshapeLike(*(bottom[0]));
+		const vector<vector<int> >& coarse_to_fine = MapLabelsLayer<Dtype>::coarse_to_fine_mapping_;
+		const int num_fine = bottom[0]->channels();
+		CHECK_LE(MapLabelsLayer<Dtype>::fine_to_coarse_mapping_.size(), num_fine)
+			<< "The mapping refers to more fine classes than bottom[0] has channels";
 		vector<int> shape = bottom[0]->shape();
-		shape[1] = MapLabelsLayer<Dtype>::coarse_to_fine_mapping_.size();
+		shape[1] = coarse_to_fine.size();
 		top[0]->Reshape(shape);
+
+		// Coarse x fine 0/1 matrix, so that the per-image reduction over fine
+		// channels is one GEMM and its gradient one GEMM with the transpose.
+		// Fine channels outside the mapping have an all zero column.
+		if (superclass_matrix_.count() == 0 || superclass_matrix_.height() != shape[1]
+			|| superclass_matrix_.width() != num_fine) {
+			superclass_matrix_.Reshape(1, 1, shape[1], num_fine);
+			Dtype* matrix = superclass_matrix_.mutable_cpu_data();
+			caffe_set(superclass_matrix_.count(), Dtype(0), matrix);
+			for (int coarse = 0; coarse < coarse_to_fine.size(); coarse++) {
+				for (int i = 0; i < coarse_to_fine[coarse].size(); i++)
+					matrix[coarse * num_fine + coarse_to_fine[coarse][i]] = 1;
+			}
+		}
 	}
 
 	template <typename Dtype>
 	void InferSuperclassesLayer<Dtype>::Forward_cpu(
 		const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-
 		const Dtype* fine_preds = bottom[0]->cpu_data();
 		Dtype* coarse_preds = top[0]->mutable_cpu_data();
-		//const int num = bottom[0]->num() * bottom[0]->channels() * bottom[0]->width() * bottom[0]->height();
-		vector<int> shape = bottom[0]->shape();
+		const Dtype* matrix = superclass_matrix_.cpu_data();
+		const int num_coarse = top[0]->channels();
+		const int num_fine = bottom[0]->channels();
+		const int spatial_dim = bottom[0]->count(2);
 
-		//Init to zero
-		caffe_set(top[0]->count(), Dtype(0), coarse_preds);
-
-		// For every fully connected output, sum the values and set the equivalent coarse value equal to that
-		//There has definitely got to be a better way to do this with selective channel adding.
-		//for (int n = 0; n < shape[0]; n++) {
-		//	for (int c = 0; c < shape[1]; c++) {
-		//		for (int h = 0; h < shape[2]; h++) {
-		//			for (int w = 0; w < shape[3]; w++) {
-		//				//caffe_set(1, )
-		//				*(coarse_preds + top[0]->offset(n,MapLabelsLayer<Dtype>::fine_to_coarse_mapping_[c],h,w)) += 
-		//			}
-		//		}
-		//	}
-		//}
-
-		// For every coarse channel, extract the fine channels and sum them to get the new coarse channel
-		const int num = shape[2] * shape[3];
-		for (int coarse = 0; coarse < MapLabelsLayer<Dtype>::coarse_to_fine_mapping_.size(); coarse++) {
-			std::vector<int>::const_iterator p = MapLabelsLayer<Dtype>::coarse_to_fine_mapping_[coarse].begin();
-			while (p != MapLabelsLayer<Dtype>::coarse_to_fine_mapping_[coarse].end()) {
-				for (int n = 0; n < shape[0]; n++) {
-					//For every fine channel, sum the coarse channel
-					Dtype *q = coarse_preds + top[0]->offset(n, coarse, 0, 0);
-					caffe_add(num, fine_preds + bottom[0]->offset(n, *p, 0, 0), q, q);
-				}
-				p++;
-			}
+		// coarse(n) = M * fine(n)
+		for (int n = 0; n < bottom[0]->num(); n++) {
+			caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_coarse, spatial_dim, num_fine,
+				Dtype(1), matrix, fine_preds + bottom[0]->offset(n), Dtype(0), coarse_preds + top[0]->offset(n));
 		}
 	}
 
 	template <typename Dtype>
 	void InferSuperclassesLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 		const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-
+		if (!propagate_down[0])
+			return;
 		const Dtype* top_diff = top[0]->cpu_diff();
 		Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+		const Dtype* matrix = superclass_matrix_.cpu_data();
+		const int num_coarse = top[0]->channels();
+		const int num_fine = bottom[0]->channels();
+		const int spatial_dim = bottom[0]->count(2);
 
-		vector<int> shape = top[0]->shape();
-		int num = shape[2] * shape[3];
-		if (propagate_down[0]) {
-			//For every fine channel, retrieve the coarse channel number and set the fine diff = to that diff
-			for (int fine = 0; fine < MapLabelsLayer<Dtype>::fine_to_coarse_mapping_.size(); fine++) {
-				for (int n = 0; n < shape[0]; n++) {
-					//For every fine channel, set the fine_diff to the coarse diff
-					caffe_copy(num, top_diff + top[0]->offset(n, MapLabelsLayer<Dtype>::fine_to_coarse_mapping_[fine], 0, 0), bottom_diff + bottom[0]->offset(n, fine, 0, 0));
-				}
-			}
+		// Every fine channel gets the diff of its coarse channel: fine(n) = M' * coarse(n)
+		for (int n = 0; n < bottom[0]->num(); n++) {
+			caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_fine, spatial_dim, num_coarse,
+				Dtype(1), matrix, top_diff + top[0]->offset(n), Dtype(0), bottom_diff + bottom[0]->offset(n));
 		}
 	}
 
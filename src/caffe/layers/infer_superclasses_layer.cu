@@ -0,0 +1,44 @@
+#include <vector>
+
+#include "caffe/layers/infer_superclasses_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void InferSuperclassesLayer<Dtype>::Forward_gpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* fine_preds = bottom[0]->gpu_data();
+  Dtype* coarse_preds = top[0]->mutable_gpu_data();
+  const Dtype* matrix = superclass_matrix_.gpu_data();
+  const int num_coarse = top[0]->channels();
+  const int num_fine = bottom[0]->channels();
+  const int spatial_dim = bottom[0]->count(2);
+  for (int n = 0; n < bottom[0]->num(); ++n) {
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_coarse, spatial_dim,
+        num_fine, Dtype(1), matrix, fine_preds + bottom[0]->offset(n),
+        Dtype(0), coarse_preds + top[0]->offset(n));
+  }
+}
+
+template <typename Dtype>
+void InferSuperclassesLayer<Dtype>::Backward_gpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  const Dtype* top_diff = top[0]->gpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
+  const Dtype* matrix = superclass_matrix_.gpu_data();
+  const int num_coarse = top[0]->channels();
+  const int num_fine = bottom[0]->channels();
+  const int spatial_dim = bottom[0]->count(2);
+  for (int n = 0; n < bottom[0]->num(); ++n) {
+    caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_fine, spatial_dim,
+        num_coarse, Dtype(1), matrix, top_diff + top[0]->offset(n),
+        Dtype(0), bottom_diff + bottom[0]->offset(n));
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(InferSuperclassesLayer);
+
+}  // namespace caffe
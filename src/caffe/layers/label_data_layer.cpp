@@ -1,10 +1,8 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
-#include <fstream>  // NOLINT(readability/streams)
-#include <iostream>  // NOLINT(readability/streams)
+#include <algorithm>
 #include <string>
-#include <utility>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
@@ -36,11 +34,11 @@ void LabelDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Read the file with filenames and labels
   const string& source = this->layer_param_.image_data_param().source();
   LOG(INFO) << "Opening file " << source;
-  std::ifstream infile(source.c_str());
-  string filename;
-  int label;
-  while (infile >> filename >> label) {
-    lines_.push_back(std::make_pair(filename, label));
+  lines_.Open(source);
+  CHECK(!lines_.empty()) << "File is empty";
+  line_order_.resize(lines_.size());
+  for (int i = 0; i < line_order_.size(); ++i) {
+    line_order_[i] = i;
   }
 
   if (this->layer_param_.image_data_param().shuffle()) {
@@ -62,9 +60,10 @@ void LabelDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     lines_id_ = skip;
   }
   // Read an image, and use it to initialize the top blob.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+  const int first_line = line_order_[lines_id_];
+  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_.name(first_line),
                                     new_height, new_width, is_color, false);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  CHECK(cv_img.data) << "Could not load " << lines_.name(first_line);
   // Use data_transformer to infer the expected blob shape from a cv_image.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
   this->transformed_data_.Reshape(top_shape);
@@ -86,13 +85,29 @@ void LabelDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < this->prefetch_.size(); ++i) {
     this->prefetch_[i]->label_.Reshape(label_shape);
   }
+  // decode workers
+  const int decode_threads =
+      this->layer_param_.image_data_param().decode_threads();
+  CHECK_GT(decode_threads, 0) << "Positive number of decode threads required";
+  decode_transformers_.clear();
+  decode_transformers_.push_back(this->data_transformer_);
+  for (int i = 1; i < std::min(decode_threads, batch_size); ++i) {
+    shared_ptr<DataTransformer<Dtype> > transformer(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_));
+    transformer->InitRand();
+    decode_transformers_.push_back(transformer);
+  }
+  if (decode_transformers_.size() > 1) {
+    LOG(INFO) << "Decoding with " << decode_transformers_.size()
+        << " workers";
+  }
 }
 
 template <typename Dtype>
 void LabelDataLayer<Dtype>::ShuffleImages() {
   caffe::rng_t* prefetch_rng =
       static_cast<caffe::rng_t*>(prefetch_rng_->generator());
-  shuffle(lines_.begin(), lines_.end(), prefetch_rng);
+  shuffle(line_order_.begin(), line_order_.end(), prefetch_rng);
 }
 
 // This function is called on prefetch thread
@@ -102,7 +117,6 @@ void LabelDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   batch_timer.Start();
   double read_time = 0;
   double trans_time = 0;
-  CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
   ImageDataParameter image_data_param = this->layer_param_.image_data_param();
@@ -112,39 +126,17 @@ void LabelDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   const bool is_color = image_data_param.is_color();
   string root_folder = image_data_param.root_folder();
 
-  // Reshape according to the first image of each batch
-  // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color, false);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
-  this->transformed_data_.Reshape(top_shape);
-  // Reshape batch according to the batch_size.
-  top_shape[0] = batch_size;
-  batch->data_.Reshape(top_shape);
-
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-  // datum scales
+  // Take the files of this batch off the list first, so that the decode
+  // workers never see a reshuffle.
   const int lines_size = lines_.size();
+  vector<string> batch_files(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color, false);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
-    prefetch_label[item_id] = lines_[lines_id_].second;
+    const int line = line_order_[lines_id_];
+    batch_files[item_id] = lines_.name(line);
+    prefetch_label[item_id] = lines_.label(line);
     // go to the next iter
     lines_id_++;
     if (lines_id_ >= lines_size) {
@@ -156,6 +148,60 @@ void LabelDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+
+  // With new_height and new_width set every image comes out at the size
+  // found at setup, so the batch keeps its shape. Otherwise reshape
+  // according to the first image of each batch, which allows inputs of
+  // varying dimension on single input batches, and keep that decoded
+  // image for item 0.
+  cv::Mat first_img;
+  if (new_height == 0 || new_width == 0) {
+    CPUTimer timer;
+    timer.Start();
+    first_img = ReadImageToCVMat(root_folder + batch_files[0],
+        new_height, new_width, is_color, false);
+    CHECK(first_img.data) << "Could not load " << batch_files[0];
+    read_time += timer.MicroSeconds();
+    // Use data_transformer to infer the expected blob shape from a cv_img.
+    vector<int> top_shape = this->data_transformer_->InferBlobShape(first_img);
+    this->transformed_data_.Reshape(top_shape);
+    // Reshape batch according to the batch_size.
+    top_shape[0] = batch_size;
+    batch->data_.Reshape(top_shape);
+  }
+  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+
+  // Worker w reads and transforms items w, w + num_workers, ... in order
+  // with its own transformer, whichever thread runs it.
+  const int num_workers = decode_transformers_.size();
+  vector<double> read_times(num_workers, 0);
+  vector<double> trans_times(num_workers, 0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads(num_workers)
+#endif
+  for (int worker = 0; worker < num_workers; ++worker) {
+    CPUTimer timer;
+    Blob<Dtype> transformed_data(this->transformed_data_.shape());
+    for (int item_id = worker; item_id < batch_size; item_id += num_workers) {
+      // get a blob
+      timer.Start();
+      cv::Mat cv_img = item_id == 0 && first_img.data ? first_img :
+          ReadImageToCVMat(root_folder + batch_files[item_id],
+              new_height, new_width, is_color, false);
+      CHECK(cv_img.data) << "Could not load " << batch_files[item_id];
+      read_times[worker] += timer.MicroSeconds();
+      timer.Start();
+      // Apply transformations (mirror, crop...) to the image
+      int offset = batch->data_.offset(item_id);
+      transformed_data.set_cpu_data(prefetch_data + offset);
+      decode_transformers_[worker]->Transform(cv_img, &transformed_data);
+      trans_times[worker] += timer.MicroSeconds();
+    }
+  }
+  for (int worker = 0; worker < num_workers; ++worker) {
+    read_time += read_times[worker];
+    trans_time += trans_times[worker];
+  }
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cfloat>
+#include <fstream>
 #include <vector>
 #include <sstream>
 #include <iostream>
@@ -10,6 +11,7 @@
 void GetMappingFromFile(std::string mapping_file, std::vector< std::vector<int> > *coarse_mapping, std::vector<int> *fine_mapping) {
 	//First let's get the coarse to fine mapping
 	std::ifstream infile(mapping_file.c_str());
+	CHECK(infile.good()) << "Failed to open mapping file " << mapping_file;
 	std::string line;
 	int line_num = 0;
 	int max_fine = 0;
@@ -20,6 +22,8 @@ void GetMappingFromFile(std::string mapping_file, std::vector< std::vector<int>
 		int i;
 		while (ss >> i)
 		{
+			CHECK_GE(i, 0) << "Negative fine label on line " << line_num + 1
+				<< " of " << mapping_file;
 			if (i > max_fine)
 				max_fine = i;
 			(*coarse_mapping)[line_num].push_back(i);
@@ -29,13 +33,17 @@ void GetMappingFromFile(std::string mapping_file, std::vector< std::vector<int>
 		++line_num;
 	}
 	infile.close();
+	CHECK_GT(coarse_mapping->size(), 0) << "Empty mapping file " << mapping_file;
 
 	//Not let's get the fine to coarse mapping
-	fine_mapping->resize(max_fine + 1);
+	fine_mapping->assign(max_fine + 1, -1);
 	for (int coarse = 0; coarse < coarse_mapping->size(); coarse++) {
 		std::vector<int>::const_iterator p = (*coarse_mapping)[coarse].begin();
-		while (p != (*coarse_mapping)[coarse].end())
+		while (p != (*coarse_mapping)[coarse].end()) {
+			CHECK_EQ((*fine_mapping)[*p], -1) << "Fine label " << *p
+				<< " is mapped to more than one coarse label";
 			(*fine_mapping)[*p++] = coarse;
+		}
 	}
 }
 
@@ -51,6 +59,30 @@ void MapLabelsLayer<Dtype>::LayerSetUp(
 
   // Let's get the mapping
   GetMappingFromFile(mapping_file, &coarse_to_fine_mapping_, &fine_to_coarse_mapping_);
+
+  // Compile it into a table with at least one padding entry at the end, so
+  // that clamping any out of range label to the last entry ignores it. The
+  // default ignore_label may be a coarse label of a large mapping; those
+  // mappings pad with -1, which is what unmapped labels used to give.
+  const MapLabelsParameter& param = this->layer_param_.map_labels_param();
+  int ignore_label = param.ignore_label();
+  if (ignore_label >= 0 && ignore_label < coarse_to_fine_mapping_.size()) {
+    CHECK(!param.has_ignore_label())
+        << "ignore_label " << ignore_label << " is also a coarse label";
+    ignore_label = -1;
+  }
+  int table_size = 1;
+  while (table_size < fine_to_coarse_mapping_.size() + 1) {
+    table_size *= 2;
+  }
+  label_table_.Reshape(1, 1, 1, table_size);
+  Dtype* table = label_table_.mutable_cpu_data();
+  caffe_set(table_size, Dtype(ignore_label), table);
+  for (int fine = 0; fine < fine_to_coarse_mapping_.size(); ++fine) {
+    if (fine_to_coarse_mapping_[fine] >= 0) {
+      table[fine] = fine_to_coarse_mapping_[fine];
+    }
+  }
 }
 
 template <typename Dtype>
@@ -62,14 +94,20 @@ void MapLabelsLayer<Dtype>::Reshape(
 template <typename Dtype>
 void MapLabelsLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  
-	const Dtype* old_label = bottom[0]->cpu_data();
-	Dtype* new_label = top[0]->mutable_cpu_data();
-	const int num = bottom[0]->num() * bottom[0]->channels() * bottom[0]->width() * bottom[0]->height();
-
-	for (int i = 0; i < num; i++) {
-		new_label[i] = fine_to_coarse_mapping_[old_label[i]];
-	}
+  const Dtype* old_label = bottom[0]->cpu_data();
+  Dtype* new_label = top[0]->mutable_cpu_data();
+  const Dtype* table = label_table_.cpu_data();
+  const int count = bottom[0]->count();
+  // Negative labels wrap around to large unsigned values, so a single min
+  // bounds every label and the loop is a plain gather
+  const unsigned int last = label_table_.count() - 1;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < count; ++i) {
+    const unsigned int fine = static_cast<int>(old_label[i]);
+    new_label[i] = table[std::min(fine, last)];
+  }
 }
 
 template <typename Dtype>
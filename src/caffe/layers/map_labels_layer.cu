@@ -0,0 +1,36 @@
+#include <vector>
+
+#include "caffe/layers/map_labels_layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+__global__ void MapLabelsForward(const int n, const Dtype* in,
+    const Dtype* table, const unsigned int last, Dtype* out) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const unsigned int fine = static_cast<int>(in[index]);
+    out[index] = table[min(fine, last)];
+  }
+}
+
+template <typename Dtype>
+void MapLabelsLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->gpu_data();
+  Dtype* top_data = top[0]->mutable_gpu_data();
+  const int count = bottom[0]->count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  MapLabelsForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, bottom_data, label_table_.gpu_data(), label_table_.count() - 1,
+      top_data);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template <typename Dtype>
+void MapLabelsLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(MapLabelsLayer);
+
+}  // namespace caffe
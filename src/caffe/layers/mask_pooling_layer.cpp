@@ -7,6 +7,7 @@
 
 
 #include "caffe/layers/mask_pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
   
@@ -26,18 +27,73 @@ void MaskPoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom, const
   CHECK_EQ(bottom[0]->height(), bottom[1]->height()) << "feature map height and mask height must be the same";
   CHECK_EQ(bottom[0]->width(), bottom[1]->width()) << "feature map width and mask width must be the same";
   CHECK_EQ(bottom[0]->num(), bottom[1]->num()) << "feature map num and mask num must be the same";
+  CHECK_EQ(bottom[1]->channels(), 1) << "mask must have a single channel";
 }
 
 template <typename Dtype>
 void MaskPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  // bottom[0] is feature maps, of shape (n x c x h x w)
+  // bottom[1] is masks, of shape (n x 1 x h x w)
+  // output(n, c, h, w) = input_feature(n, c, h, w) * input_mask(n, 1, h, w)
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* bottom_masks = bottom[1]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int num_planes = bottom[0]->num() * channels_;
+  const int spatial_dim = height_ * width_;
+  // Every (n, c) plane is an independent element-wise product with mask n,
+  // so planes are spread over threads and each one is a single vector op.
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int plane = 0; plane < num_planes; ++plane) {
+    const int n = plane / channels_;
+    caffe_mul(spatial_dim, bottom_data + plane * spatial_dim,
+        bottom_masks + n * spatial_dim, top_data + plane * spatial_dim);
+  }
 }
 
 template <typename Dtype>
 void MaskPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* bottom_masks = bottom[1]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const int num = bottom[0]->num();
+  const int spatial_dim = height_ * width_;
+  if (propagate_down[0]) {
+    // d(output) / d(feature) is the mask itself
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    const int num_planes = num * channels_;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int plane = 0; plane < num_planes; ++plane) {
+      const int n = plane / channels_;
+      caffe_mul(spatial_dim, top_diff + plane * spatial_dim,
+          bottom_masks + n * spatial_dim, bottom_diff + plane * spatial_dim);
+    }
+  }
+  if (propagate_down[1]) {
+    // d(output) / d(mask) sums top_diff * feature over channels; each image
+    // owns its mask plane, so images run in parallel without sharing writes.
+    Dtype* bottom_mask_diff = bottom[1]->mutable_cpu_diff();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int n = 0; n < num; ++n) {
+      Dtype* mask_diff = bottom_mask_diff + n * spatial_dim;
+      caffe_set(spatial_dim, Dtype(0), mask_diff);
+      for (int c = 0; c < channels_; ++c) {
+        const int offset = (n * channels_ + c) * spatial_dim;
+        const Dtype* plane_top_diff = top_diff + offset;
+        const Dtype* plane_data = bottom_data + offset;
+        for (int i = 0; i < spatial_dim; ++i) {
+          mask_diff[i] += plane_top_diff[i] * plane_data[i];
+        }
+      }
+    }
+  }
 }
 
 #ifdef CPU_ONLY
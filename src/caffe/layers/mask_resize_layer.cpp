@@ -5,7 +5,10 @@
 // Licensed under The MIT License [see LICENSE for details]
 // --------------------------------------------------------
 
+#include <vector>
+
 #include "caffe/layers/mask_resize_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -23,22 +26,139 @@ template <typename Dtype>
 void MaskResizeLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   input_channels_ = bottom[0]->channels();
   output_channels_ = input_channels_;
-  input_height_ = bottom[0]->height();
-  input_width_ = bottom[0]->width();
-  
+  // the taps only depend on the input size, so only rebuild them on change
+  if (row_low_.empty() || bottom[0]->height() != input_height_) {
+    input_height_ = bottom[0]->height();
+    ComputeTaps(input_height_, output_height_, &row_low_, &row_high_,
+        &row_frac_);
+  }
+  if (col_low_.empty() || bottom[0]->width() != input_width_) {
+    input_width_ = bottom[0]->width();
+    ComputeTaps(input_width_, output_width_, &col_low_, &col_high_,
+        &col_frac_);
+  }
+
   top[0]->Reshape(bottom[0]->num(), output_channels_, output_height_, output_width_);
 }
 
+template <typename Dtype>
+void MaskResizeLayer<Dtype>::ComputeTaps(const int input_size,
+    const int output_size, vector<int>* low, vector<int>* high,
+    vector<Dtype>* frac) {
+  // Same sampling grid and border handling as bilinear_interpolate in
+  // mask_resize_layer.cu: output o samples the input at o * ratio.
+  const Dtype ratio = static_cast<Dtype>(input_size) /
+      static_cast<Dtype>(output_size);
+  low->resize(output_size);
+  high->resize(output_size);
+  frac->resize(output_size);
+  for (int o = 0; o < output_size; ++o) {
+    Dtype pos = o * ratio;
+    if (pos < -0.5 || pos > input_size - 0.5) {
+      (*low)[o] = (*high)[o] = -1;
+      (*frac)[o] = 0;
+      continue;
+    }
+    if (pos <= 0) pos = 0;
+    int pos_low = static_cast<int>(pos);
+    int pos_high;
+    if (pos_low >= input_size - 1) {
+      pos_high = pos_low = input_size - 1;
+      pos = static_cast<Dtype>(pos_low);
+    } else {
+      pos_high = pos_low + 1;
+    }
+    (*low)[o] = pos_low;
+    (*high)[o] = pos_high;
+    (*frac)[o] = pos - pos_low;
+  }
+}
+
 template <typename Dtype>
 void MaskResizeLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int num_masks = bottom[0]->num() * input_channels_;
+  const int input_dim = input_height_ * input_width_;
+  const int output_dim = output_height_ * output_width_;
+  // every mask is resized independently with the shared tap tables
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int m = 0; m < num_masks; ++m) {
+    const Dtype* mask = bottom_data + m * input_dim;
+    Dtype* out = top_data + m * output_dim;
+    for (int h = 0; h < output_height_; ++h) {
+      Dtype* out_row = out + h * output_width_;
+      if (row_low_[h] < 0) {
+        caffe_set(output_width_, Dtype(0), out_row);
+        continue;
+      }
+      const Dtype* row_low = mask + row_low_[h] * input_width_;
+      const Dtype* row_high = mask + row_high_[h] * input_width_;
+      const Dtype lh = row_frac_[h];
+      for (int w = 0; w < output_width_; ++w) {
+        const int w_low = col_low_[w];
+        if (w_low < 0) {
+          out_row[w] = 0;
+          continue;
+        }
+        const int w_high = col_high_[w];
+        const Dtype lw = col_frac_[w];
+        const Dtype top_val = row_low[w_low] +
+            lw * (row_low[w_high] - row_low[w_low]);
+        const Dtype bottom_val = row_high[w_low] +
+            lw * (row_high[w_high] - row_high[w_low]);
+        out_row[w] = top_val + lh * (bottom_val - top_val);
+      }
+    }
+  }
 }
 
 template <typename Dtype>
 void MaskResizeLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const int num_masks = bottom[0]->num() * input_channels_;
+  const int input_dim = input_height_ * input_width_;
+  const int output_dim = output_height_ * output_width_;
+  // Scatter every output gradient onto its four taps. Masks never share
+  // input pixels, so they are processed in parallel without conflicts.
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int m = 0; m < num_masks; ++m) {
+    const Dtype* diff = top_diff + m * output_dim;
+    Dtype* mask_diff = bottom_diff + m * input_dim;
+    caffe_set(input_dim, Dtype(0), mask_diff);
+    for (int h = 0; h < output_height_; ++h) {
+      if (row_low_[h] < 0) {
+        continue;
+      }
+      Dtype* row_low = mask_diff + row_low_[h] * input_width_;
+      Dtype* row_high = mask_diff + row_high_[h] * input_width_;
+      const Dtype lh = row_frac_[h];
+      const Dtype* diff_row = diff + h * output_width_;
+      for (int w = 0; w < output_width_; ++w) {
+        const int w_low = col_low_[w];
+        if (w_low < 0) {
+          continue;
+        }
+        const int w_high = col_high_[w];
+        const Dtype lw = col_frac_[w];
+        const Dtype g = diff_row[w];
+        row_low[w_low] += (1 - lh) * (1 - lw) * g;
+        row_low[w_high] += (1 - lh) * lw * g;
+        row_high[w_low] += lh * (1 - lw) * g;
+        row_high[w_high] += lh * lw * g;
+      }
+    }
+  }
 }
   
 #ifdef CPU_ONLY
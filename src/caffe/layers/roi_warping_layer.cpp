@@ -6,8 +6,11 @@
 // --------------------------------------------------------
 
 #include <cfloat>
+#include <vector>
 
 #include "caffe/layers/roi_warping_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/openmp.hpp"
 
 using std::max;
 using std::min;
@@ -16,6 +19,91 @@ using std::ceil;
 
 namespace caffe {
 
+// Bilinear sampling position along one axis of the feature map. Warping is
+// separable, so the taps of an ROI are computed once per output row and once
+// per output column and then shared by every channel of that ROI.
+template <typename Dtype>
+struct WarpTap {
+  int low;
+  int high;
+  Dtype frac;  // weight of the high tap
+  Dtype pos;   // clamped sampling position (recorded as the argmax)
+  bool valid;
+};
+
+// Mirrors the boundary handling of bilinear_interpolate in the CUDA kernel
+template <typename Dtype>
+static void ComputeWarpTaps(const Dtype start, const Dtype bin_size,
+    const int pooled_size, const int size, vector<WarpTap<Dtype> >* taps) {
+  taps->resize(pooled_size);
+  for (int p = 0; p < pooled_size; ++p) {
+    WarpTap<Dtype>& tap = (*taps)[p];
+    Dtype pos = start + static_cast<Dtype>(p) * bin_size;
+    tap.valid = !(pos < -0.5 || pos > size - 0.5);
+    if (!tap.valid) {
+      tap.low = tap.high = 0;
+      tap.frac = 0;
+      tap.pos = -1;
+      continue;
+    }
+    if (pos <= 0) pos = 0;
+    tap.low = static_cast<int>(pos);
+    if (tap.low >= size - 1) {
+      tap.high = tap.low = size - 1;
+      pos = static_cast<Dtype>(tap.low);
+    } else {
+      tap.high = tap.low + 1;
+    }
+    tap.frac = pos - tap.low;
+    tap.pos = pos;
+  }
+}
+
+// CPU counterpart of get_coordinate_gradient in roi_warping_layer.cu
+template <typename Dtype>
+static Dtype CoordinateGradient(const int coordinate_index, const Dtype h,
+    const Dtype w, const Dtype* offset_bottom_data, const Dtype oh,
+    const Dtype ow, const int height, const int width,
+    const int pooled_height, const int pooled_width) {
+  const int arg_interpolate_h = static_cast<int>(h);
+  const int arg_interpolate_w = static_cast<int>(w);
+  if (arg_interpolate_h + 1 > height - 1 ||
+      arg_interpolate_w + 1 > width - 1) {
+    return 0;
+  }
+  const Dtype map_ratio_h = oh / static_cast<Dtype>(pooled_height);
+  const Dtype map_ratio_w = ow / static_cast<Dtype>(pooled_width);
+  const Dtype lh = h - arg_interpolate_h;
+  const Dtype lw = w - arg_interpolate_w;
+  const Dtype v1 = offset_bottom_data[arg_interpolate_h * width +
+      arg_interpolate_w];
+  const Dtype v2 = offset_bottom_data[arg_interpolate_h * width +
+      arg_interpolate_w + 1];
+  const Dtype v3 = offset_bottom_data[(arg_interpolate_h + 1) * width +
+      arg_interpolate_w];
+  const Dtype v4 = offset_bottom_data[(arg_interpolate_h + 1) * width +
+      arg_interpolate_w + 1];
+
+  const Dtype dxc = (1 - lh) * (v2 - v1) + lh * (v4 - v3);
+  const Dtype dyc = (1 - lw) * (v3 - v1) + lw * (v4 - v2);
+  const Dtype dw = (0.5 - map_ratio_w) * ((1 - lh) * (v1 - v2) +
+      lh * (v3 - v4));
+  const Dtype dh = (0.5 - map_ratio_h) * ((1 - lw) * (v1 - v3) +
+      lw * (v2 - v4));
+  switch (coordinate_index) {
+  case 1:
+    return 0.5 * dxc - dw;
+  case 2:
+    return 0.5 * dyc - dh;
+  case 3:
+    return 0.5 * dxc + dw;
+  case 4:
+    return 0.5 * dyc + dh;
+  default:
+    return 0;
+  }
+}
+
 template <typename Dtype>
 void ROIWarpingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -44,13 +132,197 @@ void ROIWarpingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom, const v
 template <typename Dtype>
 void ROIWarpingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* bottom_rois = bottom[1]->cpu_data();
+  const int num_rois = bottom[1]->num();
+  const int batch_size = bottom[0]->num();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  Dtype* argmax_data_h = max_idx_h_.mutable_cpu_data();
+  Dtype* argmax_data_w = max_idx_w_.mutable_cpu_data();
+  const int spatial_dim = height_ * width_;
+  const int pooled_dim = pooled_height_ * pooled_width_;
+
+  // Each ROI writes only its own slice of top, so ROIs run in parallel
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int n = 0; n < num_rois; ++n) {
+    const Dtype* roi = bottom_rois + n * 5;
+    const int roi_batch_ind = roi[0];
+    CHECK_GE(roi_batch_ind, 0);
+    CHECK_LT(roi_batch_ind, batch_size);
+    const Dtype roi_start_w = round(roi[1] * spatial_scale_);
+    const Dtype roi_start_h = round(roi[2] * spatial_scale_);
+    const Dtype roi_end_w = round(roi[3] * spatial_scale_);
+    const Dtype roi_end_h = round(roi[4] * spatial_scale_);
+    const Dtype roi_width = max(roi_end_w - roi_start_w, Dtype(0));
+    const Dtype roi_height = max(roi_end_h - roi_start_h, Dtype(0));
+    vector<WarpTap<Dtype> > taps_h, taps_w;
+    ComputeWarpTaps(roi_start_h, roi_height / pooled_height_, pooled_height_,
+        height_, &taps_h);
+    ComputeWarpTaps(roi_start_w, roi_width / pooled_width_, pooled_width_,
+        width_, &taps_w);
+
+    for (int c = 0; c < channels_; ++c) {
+      const Dtype* plane = bottom_data +
+          (roi_batch_ind * channels_ + c) * spatial_dim;
+      const int offset = (n * channels_ + c) * pooled_dim;
+      Dtype* out = top_data + offset;
+      Dtype* out_h = argmax_data_h + offset;
+      Dtype* out_w = argmax_data_w + offset;
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        const WarpTap<Dtype>& th = taps_h[ph];
+        const Dtype* row_low = plane + th.low * width_;
+        const Dtype* row_high = plane + th.high * width_;
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          const WarpTap<Dtype>& tw = taps_w[pw];
+          const int index = ph * pooled_width_ + pw;
+          if (!th.valid || !tw.valid) {
+            // nothing sampled: argmax = -1 propagates no gradient
+            out[index] = 0;
+            out_h[index] = -1;
+            out_w[index] = -1;
+            continue;
+          }
+          const Dtype top_val = row_low[tw.low] +
+              tw.frac * (row_low[tw.high] - row_low[tw.low]);
+          const Dtype bottom_val = row_high[tw.low] +
+              tw.frac * (row_high[tw.high] - row_high[tw.low]);
+          out[index] = top_val + th.frac * (bottom_val - top_val);
+          out_h[index] = th.pos;
+          out_w[index] = tw.pos;
+        }
+      }
+    }
+  }
 }
 
 template <typename Dtype>
 void ROIWarpingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* bottom_rois = bottom[1]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* argmax_data_h = max_idx_h_.cpu_data();
+  const Dtype* argmax_data_w = max_idx_w_.cpu_data();
+  const int num_rois = top[0]->num();
+  const int spatial_dim = height_ * width_;
+  const int pooled_dim = pooled_height_ * pooled_width_;
+
+  // backpropagation to feature map
+  if (propagate_down[0]) {
+    // ROIs of the same image overlap, so every thread scatters into a
+    // private copy of bottom_diff; the copies are summed in a second pass.
+    // The runtime may grant fewer threads than requested, and only the
+    // copies of the threads that ran are summed.
+    const int count = bottom[0]->count();
+    int num_threads = min(caffe_omp_max_threads(), max(num_rois, 1));
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    Dtype* thread_diff = bottom_diff;
+    if (num_threads > 1) {
+      thread_diff_.Reshape(num_threads, count, 1, 1);
+      thread_diff = thread_diff_.mutable_cpu_data();
+    }
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads)
+#endif
+    {
+      Dtype* diff = thread_diff + caffe_omp_thread_num() * count;
+      caffe_set(count, Dtype(0), diff);
+#ifdef _OPENMP
+#pragma omp single
+#endif
+      num_threads = caffe_omp_num_threads();
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (int n = 0; n < num_rois; ++n) {
+        const int roi_batch_ind = bottom_rois[n * 5];
+        for (int c = 0; c < channels_; ++c) {
+          Dtype* plane = diff + (roi_batch_ind * channels_ + c) * spatial_dim;
+          const int offset = (n * channels_ + c) * pooled_dim;
+          for (int index = 0; index < pooled_dim; ++index) {
+            const Dtype h = argmax_data_h[offset + index];
+            const Dtype w = argmax_data_w[offset + index];
+            if (h < 0 || w < 0) {
+              continue;
+            }
+            // the argmax is the clamped sampling position, so the taps are
+            // recovered exactly as in the forward pass
+            const int h_low = static_cast<int>(h);
+            const int w_low = static_cast<int>(w);
+            const int h_high = min(h_low + 1, height_ - 1);
+            const int w_high = min(w_low + 1, width_ - 1);
+            const Dtype lh = h - h_low;
+            const Dtype lw = w - w_low;
+            const Dtype grad = top_diff[offset + index];
+            plane[h_low * width_ + w_low] += (1 - lh) * (1 - lw) * grad;
+            plane[h_low * width_ + w_high] += (1 - lh) * lw * grad;
+            plane[h_high * width_ + w_low] += lh * (1 - lw) * grad;
+            plane[h_high * width_ + w_high] += lh * lw * grad;
+          }
+        }
+      }
+    }
+    if (num_threads > 1) {
+      // fixed summation order keeps the result independent of scheduling
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (int i = 0; i < count; ++i) {
+        Dtype sum = 0;
+        for (int t = 0; t < num_threads; ++t) {
+          sum += thread_diff[t * count + i];
+        }
+        bottom_diff[i] = sum;
+      }
+    }
+  }
+
+  // backpropagation to coordinate: each ROI owns its 5 coordinate diffs
+  if (propagate_down[1]) {
+    Dtype* bottom_rois_diff = bottom[1]->mutable_cpu_diff();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int n = 0; n < num_rois; ++n) {
+      const Dtype* roi = bottom_rois + n * 5;
+      const int roi_batch_ind = roi[0];
+      const int roi_start_w = round(roi[1] * spatial_scale_);
+      const int roi_start_h = round(roi[2] * spatial_scale_);
+      const int roi_end_w = round(roi[3] * spatial_scale_);
+      const int roi_end_h = round(roi[4] * spatial_scale_);
+      // Force malformed ROIs to be 1x1
+      const int roi_width = max(roi_end_w - roi_start_w + 1, 1);
+      const int roi_height = max(roi_end_h - roi_start_h + 1, 1);
+      const Dtype bin_size_h = static_cast<Dtype>(roi_height) /
+          static_cast<Dtype>(pooled_height_);
+      const Dtype bin_size_w = static_cast<Dtype>(roi_width) /
+          static_cast<Dtype>(pooled_width_);
+      Dtype gradient[5] = {0, 0, 0, 0, 0};
+      for (int c = 0; c < channels_; ++c) {
+        const Dtype* plane = bottom_data +
+            (roi_batch_ind * channels_ + c) * spatial_dim;
+        const int offset = (n * channels_ + c) * pooled_dim;
+        for (int index = 0; index < pooled_dim; ++index) {
+          const Dtype ih = argmax_data_h[offset + index];
+          const Dtype iw = argmax_data_w[offset + index];
+          if (ih < 0 || iw < 0) {
+            continue;
+          }
+          const Dtype output_h = (ih - roi_start_h) / bin_size_h;
+          const Dtype output_w = (iw - roi_start_w) / bin_size_w;
+          const Dtype grad = spatial_scale_ * top_diff[offset + index];
+          for (int k = 1; k < 5; ++k) {
+            gradient[k] += grad * CoordinateGradient(k, ih, iw, plane,
+                output_h, output_w, height_, width_, pooled_height_,
+                pooled_width_);
+          }
+        }
+      }
+      caffe_copy(5, gradient, bottom_rois_diff + n * 5);
+    }
+  }
 }
 
 #ifdef CPU_ONLY
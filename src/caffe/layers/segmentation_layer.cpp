@@ -1,5 +1,8 @@
+#include <stdint.h>
+
 #include <algorithm>
 #include <cfloat>
+#include <cstring>
 #include <vector>
 #include <limits>
 #include <cmath>
@@ -8,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/openmp.hpp"
 #include "caffe/layers/segmentation_layer.hpp"
 #include "caffe/util/io.hpp"
 
@@ -54,6 +58,7 @@ public:
 	void CreateMask(cv::Mat &out);
 	int Width(){ return m_width; }
 	int Height(){ return m_height; }
+	int NumCenters(){ return m_centers.size(); }
 
 	float m_spThresh;
 
@@ -225,6 +230,13 @@ void SLIC::UpdateCenters(){
 		}
 		++pI; ++pC; ++pX; ++pY; ++pL; ++pA; ++pB;
 	}
+
+	free(newX);
+	free(newY);
+	free(L);
+	free(A);
+	free(B);
+	free(counter);
 }
 
 void SLIC::DrawResults(cv::Mat &display){
@@ -272,10 +284,7 @@ void SLIC::DrawResults(cv::Mat &display){
 
 
 void SLIC::CreateMask(cv::Mat &out){
-	out = m_results.clone();
-	double min, max;
-	cv::minMaxLoc(out, &min, &max);
-	printf("Min: %d, max: %d\n", (int)min, (int)max);
+	m_results.copyTo(out);
 }
 
 void SLIC::ComputeSuperPixels(const cv::Mat &image, cv::Point &topLeft, int S, int M, int iter){
@@ -329,8 +338,7 @@ class Edge {
 public:
 	float w;
 	int a, b;
-	bool valid;
-	Edge() : w(0), a(0), b(0), valid(false) { };
+	Edge() : w(0), a(0), b(0) { };
 
 	bool operator< (const Edge &other) const {
 		return (w < other.w);
@@ -349,6 +357,12 @@ class Universe
 public:
 	Universe() : num(0) { }
 	Universe(int elements)
+	{
+		reset(elements);
+	}
+	~Universe(){};
+	// Makes every element its own set again, keeping the storage
+	void reset(int elements)
 	{
 		num = elements;
 		elts.resize(num);
@@ -362,7 +376,6 @@ public:
 			i++;
 		}
 	}
-	~Universe(){};
 	int find(int x)
 	{
 		int y = x;
@@ -397,6 +410,21 @@ public:
 	int num;
 };
 
+/* Scratch memory for segmenting one image. It only ever grows, so a
+   workspace that is reused across images of the same size allocates
+   nothing after the first one. */
+class FHArena {
+public:
+	std::vector<float> smooth;     // 3 smoothed planes
+	std::vector<float> tmp;        // horizontally blurred plane
+	std::vector<float> row;        // one padded input row
+	std::vector<float> dist;       // edge weights of one row
+	std::vector<Edge> edges;
+	std::vector<Edge> sorted;      // radix sort ping-pong buffer
+	std::vector<float> threshold;
+	std::vector<int> ids;
+	Universe u;
+};
 
 void normalize(std::vector<float> &mask)
 {
@@ -414,175 +442,196 @@ void normalize(std::vector<float> &mask)
 	}
 }
 
-/* convolve src with mask.  dst is flipped! */
-void convolve_even(const cv::Mat& src, cv::Mat &dst, std::vector<float> &mask)
+/* Separable Gaussian blur of a width x height plane into dst. Both passes
+   are written as unit-stride multiply-adds over whole rows, with the
+   borders replicated up front instead of clamping every tap. */
+void iSmooth(const float *src, int width, int height, const std::vector<float> &mask, FHArena &arena, float *dst)
 {
-	int width = src.cols;
-	int height = src.rows;
-	int len = mask.size();
-	dst = cv::Mat(src.rows, src.cols, src.type());
+	const int len = mask.size();
+	const int pad = len - 1;
+	arena.tmp.resize(width * height);
+	arena.row.resize(width + 2 * pad);
+	float *tmp = &arena.tmp[0];
+	float *row = &arena.row[0];
+
+	// horizontal pass
 	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			//cout << x << ", " << y << endl;
-			float sum = mask[0] * src.at<float>(y, x);
-			for (int i = 1; i < len; i++) {
-				sum += mask[i] * (src.at<float>(y, std::max(x - i, 0)) + src.at<float>(y, std::min(x + i, width - 1)));
-			}
-			dst.at<float>(y, x) = sum;
+		const float *s = src + y * width;
+		float *t = tmp + y * width;
+		for (int x = 0; x < pad; x++) {
+			row[x] = s[0];
+			row[pad + width + x] = s[width - 1];
+		}
+		std::copy(s, s + width, row + pad);
+		const float *r = row + pad;
+		for (int x = 0; x < width; x++)
+			t[x] = mask[0] * r[x];
+		for (int i = 1; i < len; i++) {
+			const float m = mask[i];
+			const float *left = r - i, *right = r + i;
+			for (int x = 0; x < width; x++)
+				t[x] += m * (left[x] + right[x]);
 		}
 	}
-}
 
-void iExtractRGBColorSpace(const cv::Mat& in, cv::Mat &B, cv::Mat &G, cv::Mat &R) {
-	B = cv::Mat(in.rows, in.cols, CV_32F);
-	G = cv::Mat(in.rows, in.cols, CV_32F);
-	R = cv::Mat(in.rows, in.cols, CV_32F);
-	cv::Mat_<cv::Vec3b>::const_iterator pI = in.begin<cv::Vec3b>();
-	cv::Mat_<float>::iterator pB = B.begin<float>(), pG = G.begin<float>(), pR = R.begin<float>();
-	while (pI != in.end<cv::Vec3b>()) {
-		*pB = (float)(*pI)[0];
-		*pG = (float)(*pI)[1];
-		*pR = (float)(*pI)[2];
-		pI++; pB++; pG++; pR++;
+	// vertical pass, clamping whole rows at the top and bottom
+	for (int y = 0; y < height; y++) {
+		const float *t = tmp + y * width;
+		float *d = dst + y * width;
+		for (int x = 0; x < width; x++)
+			d[x] = mask[0] * t[x];
+		for (int i = 1; i < len; i++) {
+			const float m = mask[i];
+			const float *up = tmp + std::max(y - i, 0) * width;
+			const float *down = tmp + std::min(y + i, height - 1) * width;
+			for (int x = 0; x < width; x++)
+				d[x] += m * (up[x] + down[x]);
+		}
 	}
 }
 
-void iSmooth(const cv::Mat &src, float sigma, cv::Mat &out) {
-	std::vector<float> mask = make_fgauss(sigma);
-	normalize(mask);
-	cv::Mat tmp(src.rows, src.cols, src.type());
-	convolve_even(src, tmp, mask);
-	convolve_even(tmp, out, mask);
-}
-
-void iBuildGraph(const std::vector<cv::Mat> &in,
-	float sigma,
-	Edge *&edges,
-	int *num_edges)
+/* Adds the edges from every pixel of row y to its neighbour at (dy, dx),
+   for the columns [x0, x1). The colour distances of the whole run are
+   computed first in a branch-free loop. */
+inline void iAddEdges(const float *c0, const float *c1, const float *c2, int width, int y, int dy, int dx, int x0, int x1, FHArena &arena, Edge *&p)
 {
-	int width = in[0].cols;
-	int height = in[0].rows;
-	int num = 0;
-	int x, y, xp, ym, yp;
-	int safeWidth = width - 1, safeHeight = height - 1;
-	int reserve_size = in[0].rows * in[0].cols * 8;
-	//printf("Reserve size = %d\n",reserve_size);
-	edges = (Edge*)malloc(reserve_size*sizeof(Edge));
-	if (edges == NULL) {
-		printf("Error, could not malloc\n");
+	const int n = x1 - x0;
+	if (n <= 0)
 		return;
+	const int a0 = y * width + x0;
+	const int offset = dy * width + dx;
+	float *dist = &arena.dist[0];
+	for (int x = 0; x < n; x++) {
+		const int a = a0 + x;
+		const float d0 = c0[a] - c0[a + offset];
+		const float d1 = c1[a] - c1[a + offset];
+		const float d2 = c2[a] - c2[a + offset];
+		dist[x] = d0 * d0 + d1 * d1 + d2 * d2;
+	}
+	for (int x = 0; x < n; x++) {
+		p->a = a0 + x;
+		p->b = a0 + x + offset;
+		p->w = std::sqrt(dist[x]);
+		p++;
 	}
-	cv::Mat smooth_r, smooth_g, smooth_b;
-	//iExtractRGBColorSpace(in, B, G, R);
-	iSmooth(in[0], sigma, smooth_b);
-	iSmooth(in[1], sigma, smooth_g);
-	iSmooth(in[2], sigma, smooth_r);
+}
 
-	//Normalize
+/* Builds the 8-connected grid graph of the smoothed image into arena.edges
+   and returns the number of edges. */
+int iBuildGraph(const std::vector<cv::Mat> &in,
+	float sigma,
+	FHArena &arena)
+{
+	const int width = in[0].cols;
+	const int height = in[0].rows;
+	const int size = width * height;
+	std::vector<float> mask = make_fgauss(sigma);
+	normalize(mask);
 
-	Edge *p = edges;
-	cv::Mat_<float>::const_iterator pR = smooth_r.begin<float>(), pG = smooth_g.begin<float>(), pB = smooth_b.begin<float>();
-	cv::Mat_<float>::const_iterator pRBegin = pR, pGBegin = pG, pBBegin = pB;
-	for (y = 0, ym = -1, yp = 1; y < height; y++, ym++, yp++)
-	{
-		for (x = 0, xp = 1; x < width; x++, xp++)
-		{
-			//cout << x << ", " << y << endl;
-			if (x < safeWidth)
-			{
-				Edge edge;
-				edge.a = y * width + x;
-				edge.b = y * width + xp;
-				edge.w = sqrt(square(*pR - *(pRBegin + edge.b)) + square(*pG - *(pGBegin + edge.b)) + square(*pB - *(pBBegin + edge.b)));
-				//edge.valid = true;
-				*p++ = edge;
-				num++;
-			}
-			if (y < safeHeight)
-			{
-				Edge edge;
-				edge.a = y * width + x;
-				edge.b = yp * width + x;
-				edge.w = sqrt(square(*pR - *(pRBegin + edge.b)) + square(*pG - *(pGBegin + edge.b)) + square(*pB - *(pBBegin + edge.b)));
-				//edge.valid = true;
-				*p++ = edge;
-				num++;
-			}
-			if ((x < safeWidth) && (y < safeHeight))
-			{
-				Edge edge;
-				edge.a = y * width + x;
-				edge.b = yp * width + xp;
-				edge.w = sqrt(square(*pR - *(pRBegin + edge.b)) + square(*pG - *(pGBegin + edge.b)) + square(*pB - *(pBBegin + edge.b)));
-				//edge.valid = true;
-				*p++ = edge;
-				num++;
-			}
-			if ((x < safeWidth) && (y > 0))
-			{
-				Edge edge;
-				edge.a = y * width + x;
-				edge.b = ym * width + xp;
-				edge.w = sqrt(square(*pR - *(pRBegin + edge.b)) + square(*pG - *(pGBegin + edge.b)) + square(*pB - *(pBBegin + edge.b)));
-				//edge.valid = true;
-				*p++ = edge;
-				num++;
-			}
-			pR++; pG++; pB++;
+	arena.smooth.resize(3 * size);
+	for (int c = 0; c < 3; c++) {
+		CHECK(in[c].isContinuous());
+		iSmooth(in[c].ptr<float>(), width, height, mask, arena, &arena.smooth[c * size]);
+	}
+	const float *c0 = &arena.smooth[0];
+	const float *c1 = c0 + size;
+	const float *c2 = c1 + size;
+
+	// right, down, down-right and up-right of every pixel
+	const int max_edges = 4 * size;
+	if (arena.edges.size() < max_edges)
+		arena.edges.resize(max_edges);
+	arena.dist.resize(width);
+	Edge *p = &arena.edges[0];
+	for (int y = 0; y < height; y++) {
+		iAddEdges(c0, c1, c2, width, y, 0, 1, 0, width - 1, arena, p);
+		if (y < height - 1) {
+			iAddEdges(c0, c1, c2, width, y, 1, 0, 0, width, arena, p);
+			iAddEdges(c0, c1, c2, width, y, 1, 1, 0, width - 1, arena, p);
 		}
+		if (y > 0)
+			iAddEdges(c0, c1, c2, width, y, -1, 1, 0, width - 1, arena, p);
 	}
-	smooth_b.release();
-	smooth_g.release();
-	smooth_r.release();
-	*num_edges = num;
+	return p - &arena.edges[0];
 }
 
 bool lessThan(const Edge& a, const Edge& b) {
 	return a.w < b.w;
 }
 
-void iSegment_graph(int num_vertices, int num_edges, Edge*& edges, float c, Universe *u)
+/* Sorts the edges by weight in linear time. Weights are non-negative, so
+   the bit patterns of the floats order the same way as the values and an
+   LSD radix sort over them (3 passes of 11 bits) gives the same order as a
+   comparison sort, stable on ties. Passes whose digit is the same for every
+   edge are skipped. The result ends up in arena.edges. */
+void iSortEdges(int num_edges, FHArena &arena)
+{
+	const int kBits = 11;
+	const int kBuckets = 1 << kBits;
+	if (arena.sorted.size() < arena.edges.size())
+		arena.sorted.resize(arena.edges.size());
+	Edge *src = &arena.edges[0];
+	Edge *dst = &arena.sorted[0];
+	std::vector<int> count(kBuckets);
+	for (int shift = 0; shift < 32; shift += kBits) {
+		std::fill(count.begin(), count.end(), 0);
+		for (int i = 0; i < num_edges; i++) {
+			uint32_t key;
+			memcpy(&key, &src[i].w, sizeof(key));
+			count[(key >> shift) & (kBuckets - 1)]++;
+		}
+		uint32_t first;
+		memcpy(&first, &src[0].w, sizeof(first));
+		if (count[(first >> shift) & (kBuckets - 1)] == num_edges)
+			continue;
+		int sum = 0;
+		for (int b = 0; b < kBuckets; b++) {
+			const int n = count[b];
+			count[b] = sum;
+			sum += n;
+		}
+		for (int i = 0; i < num_edges; i++) {
+			uint32_t key;
+			memcpy(&key, &src[i].w, sizeof(key));
+			dst[count[(key >> shift) & (kBuckets - 1)]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+	if (src != &arena.edges[0])
+		arena.edges.swap(arena.sorted);
+}
+
+void iSegment_graph(int num_vertices, int num_edges, float c, FHArena &arena)
 {
-	Edge* pEdge = edges, *edgesEnd = pEdge + num_edges;
 	// sort edges by weight
-	std::sort(pEdge, edgesEnd);
-	//thrustsort(pEdge,edgesEnd);
+	iSortEdges(num_edges, arena);
+	Edge* pEdge = &arena.edges[0], *edgesEnd = pEdge + num_edges;
+	Universe *u = &arena.u;
 
 	// init thresholds
-	float *threshold = new float[num_vertices];
-	int i;
-	float *pThresh = threshold;
-	for (i = 0; i < num_vertices; i++)
-		*pThresh++ = THRESHOLD(1, c);
+	arena.threshold.assign(num_vertices, THRESHOLD(1, c));
+	float *threshold = &arena.threshold[0];
 
 	// for each edge, in non-decreasing weight order...
 	while (pEdge != edgesEnd)
 	{
-		//if(pEdge->valid) {
 		// components conected by this edge
 		int a = u->find(pEdge->a);
 		int b = u->find(pEdge->b);
-		if (a != b /*&& a >= 0 && b>= 0 && a < num_vertices && b < num_vertices*/) {
+		if (a != b) {
 			if ((pEdge->w <= threshold[a]) &&
 				(pEdge->w <= threshold[b])) {
 				u->join(a, b);
 				a = u->find(a);
-				if (a < num_vertices && a >= 0)
-					threshold[a] = pEdge->w + THRESHOLD(u->size(a), c);
-				else
-					printf("a is %d, which is out of bounds\n", a);
+				threshold[a] = pEdge->w + THRESHOLD(u->size(a), c);
 			}
 		}
-		//}
 		pEdge++;
 	}
-
-	// free up
-	delete[] threshold;
 }
 
-inline void iJoin_graph(Edge *&edges, int num_edges, int min_size, Universe *u) {
-	Edge *pEdge = edges, *edgesEnd = edges + num_edges;
+inline void iJoin_graph(const Edge *edges, int num_edges, int min_size, Universe *u) {
+	const Edge *pEdge = edges, *edgesEnd = edges + num_edges;
 	while (pEdge != edgesEnd)
 	{
 		int a = u->find(pEdge->a);
@@ -595,100 +644,289 @@ inline void iJoin_graph(Edge *&edges, int num_edges, int min_size, Universe *u)
 	}
 }
 
-void random_rgb(cv::Vec3b &c)
-{
-	c[0] = rand() % 255 + 1;
-	c[1] = rand() % 255 + 1;
-	c[2] = rand() % 255 + 1;
-}
-
 int FHGraphSegment(
 	std::vector<cv::Mat> &in,
 	const float sigma,
 	const float c,
 	const int min_size,
 	cv::Mat &out,
-	cv::Mat &out_color,
+	FHArena &arena,
 	const int segStartNumber = 0)
 {
 
 	int i, size = in[0].rows * in[0].cols;
-	Universe u(size);
-	Edge* edges = NULL;
-	int num_edges;
-
-	iBuildGraph(in, sigma, edges, &num_edges);
-	if (edges == NULL || num_edges == 0) {
+	int num_edges = iBuildGraph(in, sigma, arena);
+	if (num_edges == 0) {
 		printf("Error, graph has no edges\n");
 		return 0;
 	}
-	iSegment_graph(size, num_edges, edges, c, &u);
-	iJoin_graph(edges, num_edges, min_size, &u);
-
-	free(edges);
+	Universe &u = arena.u;
+	u.reset(size);
+	iSegment_graph(size, num_edges, c, arena);
+	iJoin_graph(&arena.edges[0], num_edges, min_size, &u);
 
 	int numSegs = u.num_sets();
-	cv::Vec3b *m_colors = (cv::Vec3b *)malloc(numSegs*sizeof(cv::Vec3b));
-	cv::Vec3b *pColor = m_colors;
-	for (i = 0; i < numSegs; i++)
-	{
-		cv::Vec3b color;
-		random_rgb(color);
-		*pColor++ = color;
-	}
 
-	out = cv::Mat(in[0].rows, in[0].cols, CV_32SC1);
-	out_color = cv::Mat(in[0].rows, in[0].cols, CV_8UC3);
-	cv::Mat_<int>::iterator pO = out.begin<int>();
-	cv::Mat_<cv::Vec3b>::iterator pPseudo = out_color.begin<cv::Vec3b>();
-	i = 0;
+	out.create(in[0].rows, in[0].cols, CV_32SC1);
+	int *pO = out.ptr<int>();
 	//We know there are u.num_sets() segments and size possible ids, and we want those ordered starting from 0.
-	int *m_ids = (int*)malloc(size*sizeof(int));
-	std::fill_n(m_ids, size, -1);
+	arena.ids.assign(size, -1);
+	int *m_ids = &arena.ids[0];
 	int currSeg = segStartNumber;
-	//std::map<int, int> segmentIdMap;
-	while (pO != out.end<int>()) {
+	for (i = 0; i < size; i++) {
 		int uId = u.find(i);
-		/*if (segmentIdMap.find(uId) == segmentIdMap.end()) {
-			segmentIdMap[uId] = currSeg;
-			++currSeg;
-			}
-			*pO = segmentIdMap[uId];*/
 		if (m_ids[uId] == -1) {
 			m_ids[uId] = currSeg;
 			++currSeg;
 		}
-		*pO = m_ids[uId];
-		*pPseudo = m_colors[*pO - segStartNumber];
-		++pO; ++i; ++pPseudo;
+		pO[i] = m_ids[uId];
 	}
-	free(m_ids);
-	free(m_colors);
-	u.elts.clear();
 	return numSegs;
 }
 
 /* END FH */
 /* -----------------------------------------------------------------------------------------*/
 
-int MostOccuringValue(const cv::Mat &in, const cv::Rect &bbox) {
-	cv::Rect fixedBox = bbox;
-	fixedBox.width -= fixedBox.x;
-	fixedBox.height -= fixedBox.y;
-	fixedBox.width = std::min(std::max(fixedBox.width, 1), fixedBox.width - 1);
-	fixedBox.height = std::min(std::max(fixedBox.height, 1), fixedBox.height - 1);
-
-	cv::Mat region = in(fixedBox);
-	cv::Mat_<float>::const_iterator pR = region.begin<float>();
-	std::vector<int> counts;
-	counts.resize(255);
-	while (pR != region.end<float>()) {
-		counts[(int)*pR]++;
-		++pR;
-	}
-	return std::distance(counts.begin(), std::max_element(counts.begin(), counts.end()));
+
+/* BEGIN FAST SLIC */
+/* -----------------------------------------------------------------------------------------*/
+
+/* Renumbers the ids of a label map to 0..n-1 in raster order of first
+   appearance and returns n. maxLabel bounds the ids on input. */
+int RelabelSegments(int *labels, int size, int maxLabel, std::vector<int> &ids)
+{
+	ids.assign(maxLabel, -1);
+	int numSegs = 0;
+	for (int i = 0; i < size; i++) {
+		int &id = ids[labels[i]];
+		if (id == -1)
+			id = numSegs++;
+		labels[i] = id;
+	}
+	return numSegs;
+}
+
+/* SLIC on planar float BGR images (values in 0..255). Lab planes, the
+   distance map and the centers are kept as separate arrays, and the
+   buffers are reused from one image to the next.
+
+   Assignment runs over the S x S grid cells in parallel: the pixels of a
+   cell only compare against the centers seeded in the 3 x 3 cells around
+   it, one center at a time over contiguous rows, so every thread writes
+   only its own pixels and the inner loop has no data-dependent control
+   flow. Segment spreads one image over numThreads threads; the caller
+   passes 1 when it already runs one image per thread. Iteration stops early once no center moves more than minShift
+   pixels. Unlike the SLIC class above, the distance includes the spatial
+   term weighted by (M / S)^2. */
+class FastSLIC {
+public:
+	int Segment(const float *b, const float *g, const float *r, int width, int height,
+		int S, int M, int iter, float minShift, int numThreads, int *labels);
+
+private:
+	void ConvertToLab(const float *b, const float *g, const float *r);
+	void AssignCell(int gx, int gy, int *labels);
+	void UpdateCenters(const int *labels);
+
+	int m_width, m_height, m_S, m_nx, m_ny;
+	int m_threads;
+	float m_spatial;  // (M / S)^2
+	std::vector<float> m_L, m_A, m_B, m_dist;
+	std::vector<float> m_cx, m_cy, m_cL, m_cA, m_cB;
+	std::vector<double> m_sums;  // per thread [x y L A B count] of every center
+	std::vector<int> m_ids;
+};
+
+namespace {
+
+// sRGB 0..255 -> linear
+struct SRGBTable {
+	float v[256];
+	SRGBTable() {
+		for (int i = 0; i < 256; i++) {
+			const float c = i / 255.f;
+			v[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+	}
+};
+
+// Lab f(t) on [0, 1], linearly interpolated
+struct LabFTable {
+	enum { kSize = 4096 };
+	float v[kSize + 1];
+	LabFTable() {
+		for (int i = 0; i <= kSize; i++) {
+			const float t = float(i) / kSize;
+			v[i] = t > 0.008856f ? std::pow(t, 1.f / 3.f) : 7.787f * t + 16.f / 116.f;
+		}
+	}
+	inline float operator() (float t) const {
+		t = std::min(std::max(t, 0.f), 1.f) * kSize;
+		const int i = std::min(int(t), int(kSize) - 1);
+		return v[i] + (t - i) * (v[i + 1] - v[i]);
+	}
+};
+
+const SRGBTable kSRGB;
+const LabFTable kLabF;
+
+}  // namespace
+
+void FastSLIC::ConvertToLab(const float *b, const float *g, const float *r)
+{
+	const int size = m_width * m_height;
+	float *L = &m_L[0], *A = &m_A[0], *B = &m_B[0];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(m_threads)
+#endif
+	for (int i = 0; i < size; i++) {
+		const float lr = kSRGB.v[std::min(std::max(int(r[i] + 0.5f), 0), 255)];
+		const float lg = kSRGB.v[std::min(std::max(int(g[i] + 0.5f), 0), 255)];
+		const float lb = kSRGB.v[std::min(std::max(int(b[i] + 0.5f), 0), 255)];
+		const float X = (0.412453f * lr + 0.357580f * lg + 0.180423f * lb) / 0.950456f;
+		const float Y = 0.212671f * lr + 0.715160f * lg + 0.072169f * lb;
+		const float Z = (0.019334f * lr + 0.119193f * lg + 0.950227f * lb) / 1.088754f;
+		const float fX = kLabF(X), fY = kLabF(Y), fZ = kLabF(Z);
+		L[i] = Y > 0.008856f ? 116.f * fY - 16.f : 903.3f * Y;
+		A[i] = 500.f * (fX - fY);
+		B[i] = 200.f * (fY - fZ);
+	}
+}
+
+void FastSLIC::AssignCell(int gx, int gy, int *labels)
+{
+	const int x0 = gx * m_S, x1 = std::min(x0 + m_S, m_width);
+	const int y0 = gy * m_S, y1 = std::min(y0 + m_S, m_height);
+	const int n = x1 - x0;
+	for (int y = y0; y < y1; y++)
+		std::fill(&m_dist[y * m_width + x0], &m_dist[y * m_width + x0] + n, std::numeric_limits<float>::max());
+	for (int ny = std::max(gy - 1, 0); ny <= std::min(gy + 1, m_ny - 1); ny++) {
+		for (int nx = std::max(gx - 1, 0); nx <= std::min(gx + 1, m_nx - 1); nx++) {
+			const int k = ny * m_nx + nx;
+			const float cx = m_cx[k], cy = m_cy[k];
+			const float cL = m_cL[k], cA = m_cA[k], cB = m_cB[k];
+			for (int y = y0; y < y1; y++) {
+				const int offset = y * m_width + x0;
+				const float *L = &m_L[offset], *A = &m_A[offset], *B = &m_B[offset];
+				float *dist = &m_dist[offset];
+				int *label = labels + offset;
+				const float dy2 = m_spatial * (y - cy) * (y - cy);
+				for (int x = 0; x < n; x++) {
+					const float dx = x0 + x - cx;
+					const float dL = L[x] - cL, dA = A[x] - cA, dB = B[x] - cB;
+					const float d = dL * dL + dA * dA + dB * dB + m_spatial * dx * dx + dy2;
+					const bool closer = d < dist[x];
+					dist[x] = closer ? d : dist[x];
+					label[x] = closer ? k : label[x];
+				}
+			}
+		}
+	}
+}
+
+void FastSLIC::UpdateCenters(const int *labels)
+{
+	const int num_centers = m_cx.size();
+	// every slice is zeroed, so a smaller team than requested leaves the
+	// slices it does not use at zero
+	const int num_threads = m_threads;
+	m_sums.assign(num_threads * num_centers * 6, 0.);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads)
+#endif
+	{
+		double *sums = &m_sums[caffe::caffe_omp_thread_num() * num_centers * 6];
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+		for (int y = 0; y < m_height; y++) {
+			for (int x = 0; x < m_width; x++) {
+				const int i = y * m_width + x;
+				double *s = sums + labels[i] * 6;
+				s[0] += x;
+				s[1] += y;
+				s[2] += m_L[i];
+				s[3] += m_A[i];
+				s[4] += m_B[i];
+				s[5] += 1;
+			}
+		}
+	}
+	for (int t = 1; t < num_threads; t++) {
+		const double *sums = &m_sums[t * num_centers * 6];
+		for (int j = 0; j < num_centers * 6; j++)
+			m_sums[j] += sums[j];
+	}
+}
+
+int FastSLIC::Segment(const float *b, const float *g, const float *r, int width, int height,
+	int S, int M, int iter, float minShift, int numThreads, int *labels)
+{
+	const int size = width * height;
+	m_threads = std::max(numThreads, 1);
+	m_width = width;
+	m_height = height;
+	m_S = std::max(S, 1);
+	m_spatial = float(M) * M / (float(m_S) * m_S);
+	m_nx = (width + m_S - 1) / m_S;
+	m_ny = (height + m_S - 1) / m_S;
+	const int num_centers = m_nx * m_ny;
+	m_L.resize(size);
+	m_A.resize(size);
+	m_B.resize(size);
+	m_dist.resize(size);
+	ConvertToLab(b, g, r);
+
+	// one center in the middle of every grid cell
+	m_cx.resize(num_centers);
+	m_cy.resize(num_centers);
+	m_cL.resize(num_centers);
+	m_cA.resize(num_centers);
+	m_cB.resize(num_centers);
+	for (int gy = 0; gy < m_ny; gy++) {
+		for (int gx = 0; gx < m_nx; gx++) {
+			const int k = gy * m_nx + gx;
+			const int x = std::min(gx * m_S + m_S / 2, width - 1);
+			const int y = std::min(gy * m_S + m_S / 2, height - 1);
+			m_cx[k] = x;
+			m_cy[k] = y;
+			m_cL[k] = m_L[y * width + x];
+			m_cA[k] = m_A[y * width + x];
+			m_cB[k] = m_B[y * width + x];
+		}
+	}
+
+	const float minShift2 = minShift * minShift;
+	for (int it = 0; it < std::max(iter, 1); it++) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(m_threads)
+#endif
+		for (int cell = 0; cell < num_centers; cell++)
+			AssignCell(cell % m_nx, cell / m_nx, labels);
+
+		UpdateCenters(labels);
+		float maxShift2 = 0;
+		for (int k = 0; k < num_centers; k++) {
+			const double *s = &m_sums[k * 6];
+			if (s[5] == 0)
+				continue;  // no pixels, keep the center where it is
+			const float x = s[0] / s[5], y = s[1] / s[5];
+			maxShift2 = std::max(maxShift2, square(x - m_cx[k]) + square(y - m_cy[k]));
+			m_cx[k] = x;
+			m_cy[k] = y;
+			m_cL[k] = s[2] / s[5];
+			m_cA[k] = s[3] / s[5];
+			m_cB[k] = s[4] / s[5];
+		}
+		if (maxShift2 <= minShift2)
+			break;
+	}
+	return RelabelSegments(labels, size, num_centers, m_ids);
 }
 
+/* END FAST SLIC */
+/* -----------------------------------------------------------------------------------------*/
+
 namespace caffe {
 
 	template <typename Dtype>
@@ -713,13 +951,26 @@ namespace caffe {
 		}
 	}
 
+	// Computes, in one pass over the segment map (and the label map when
+	// given), the box ([x1 y1 x2 y2], extended by bb_extension and clipped),
+	// the pixel area and the most frequent label of each of the numSegs
+	// segments of one image. Segment ids in seg are local to the image
+	// (0..numSegs). The label histograms only have a bin for each label that
+	// occurs in the image, the smaller label winning ties. Negative labels
+	// are not counted, and a segment without any label gets -1.
 	template <typename Dtype>
-	void ExtractSegBoxes(const std::vector<cv::Mat> &in, const cv::Mat &seg, cv::Mat &label, int numSegs, const int segStartNumber, const int imgNum, const int bb_extension, const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top, bool labelsProvided) {
-		//We need to extract a bounding box of each segment
-		//const Dtype* bottom_data = bottom[0]->cpu_data();
-		//lets extract the bounding box first.
-		std::vector<cv::Rect> boxes;
+	void ComputeSegBoxes(const cv::Mat &seg, const Dtype *label, int numSegs, const int bb_extension, std::vector<cv::Rect> &boxes, std::vector<int> &areas, std::vector<int> &modes) {
+		const int size = seg.rows * seg.cols;
+		const int *pS = seg.ptr<int>();
+		if (numSegs == 0) {
+			// nothing was segmented and seg holds no ids
+			boxes.clear();
+			areas.clear();
+			modes.clear();
+			return;
+		}
 		boxes.resize(numSegs);
+		areas.assign(numSegs, 0);
 		std::vector<cv::Rect>::iterator pB = boxes.begin();
 		while (pB != boxes.end()) {
 			pB->x = seg.cols;
@@ -728,41 +979,57 @@ namespace caffe {
 			pB->height = 0;
 			++pB;
 		}
-		cv::Mat_<int>::const_iterator pS = seg.begin<int>();
+
+		// dense index of every label value present in the image
+		std::vector<int> bin;
+		std::vector<int> values;
+		if (label) {
+			for (int j = 0; j < size; j++) {
+				const int l = static_cast<int>(label[j]);
+				if (l < 0)
+					continue;
+				if (l >= bin.size())
+					bin.resize(l + 1, -1);
+				bin[l] = 0;
+			}
+			for (int l = 0; l < bin.size(); l++) {
+				if (bin[l] == 0) {
+					bin[l] = values.size();
+					values.push_back(l);
+				}
+			}
+		}
+		const int numBins = values.size();
+		std::vector<int> hist(numSegs * numBins, 0);
+
 		//For now, width and height will just be the greater x,y positions
-		for (int j = 0; j < seg.rows; j++) {
-			for (int i = 0; i < seg.cols; i++) {
-				int correctedId = (*pS) - segStartNumber;
-				if (i < boxes[correctedId].x)
-					boxes[correctedId].x = i;
-				if (j < boxes[correctedId].y)
-					boxes[correctedId].y = j;
-				if (i > boxes[correctedId].width)
-					boxes[correctedId].width = i;
-				if (j > boxes[correctedId].height)
-					boxes[correctedId].height = j;
-				++pS;
+		for (int j = 0, p = 0; j < seg.rows; j++) {
+			for (int i = 0; i < seg.cols; i++, p++) {
+				const int id = pS[p];
+				cv::Rect &box = boxes[id];
+				box.x = std::min(box.x, i);
+				box.y = std::min(box.y, j);
+				box.width = std::max(box.width, i);
+				box.height = std::max(box.height, j);
+				areas[id]++;
+				if (numBins > 0) {
+					const int l = static_cast<int>(label[p]);
+					if (l >= 0)
+						hist[id * numBins + bin[l]]++;
+				}
 			}
 		}
+
+		modes.assign(numSegs, -1);
+		for (int id = 0; id < numSegs && numBins > 0; id++) {
+			const int *h = &hist[id * numBins];
+			const int best = std::max_element(h, h + numBins) - h;
+			if (h[best] > 0)
+				modes[id] = values[best];
+		}
+
 		int safeWidth = seg.cols - 1, safeHeight = seg.rows - 1;
-		pB = boxes.begin();
-		//std::vector<int> newShape = { numSegs + segStartNumber, 3, segHeight, segWidth };
-		//top[0]->Reshape(newShape);
-		//printf("Num Segs: %d\n", numSegs);
-		int totalSegs = numSegs + segStartNumber;
-		//std::vector<int> top_shape = { totalSegs, 5, 1, 1 };
-		top[0]->Reshape(totalSegs, 5, 1, 1);
-		Dtype* seg_data = top[0]->mutable_cpu_data();
-		Dtype* label_data;
-		if (labelsProvided) {
-			//std::vector<int> top2_shape = { totalSegs };
-			top[1]->Reshape(totalSegs, 1, 1, 1);
-			label_data = top[1]->mutable_cpu_data();
-		}
-		//float *segLabels = (float*)malloc(numSegs * sizeof(float));
-		//float *pSL = segLabels;
-		int currSeg = segStartNumber;
-		for (int i = 0; i < numSegs; i++, pB++, currSeg++) {
+		for (pB = boxes.begin(); pB != boxes.end(); ++pB) {
 			//first lets scale our box appropriately and extend it
 			pB->width += bb_extension;
 			pB->height += bb_extension;
@@ -772,63 +1039,96 @@ namespace caffe {
 			pB->y = std::min(std::max(pB->y, 0), safeHeight - 1);
 			pB->width = std::min(std::max(pB->width, 1), safeWidth);
 			pB->height = std::min(std::max(pB->height, 1), safeHeight);
+		}
+	}
+
+	// Orders segment ids by decreasing area, the lower id first on ties.
+	class LargerSegment {
+	public:
+		explicit LargerSegment(const std::vector<int> &areas) : areas_(areas) { }
+		bool operator() (int a, int b) const {
+			return areas_[a] > areas_[b] || (areas_[a] == areas_[b] && a < b);
+		}
+	private:
+		const std::vector<int> &areas_;
+	};
+
+	// Maps each segment to its output slot, or to -1 if it is dropped. With
+	// maxSegs > 0 only the maxSegs largest segments are kept; slots follow
+	// the segment ids either way. Returns the number of segments kept.
+	int SelectSegments(const std::vector<int> &areas, const int maxSegs, std::vector<int> &slots) {
+		const int numSegs = areas.size();
+		if (maxSegs <= 0 || numSegs <= maxSegs) {
+			slots.resize(numSegs);
+			for (int i = 0; i < numSegs; i++)
+				slots[i] = i;
+			return numSegs;
+		}
+		std::vector<int> order(numSegs);
+		for (int i = 0; i < numSegs; i++)
+			order[i] = i;
+		std::nth_element(order.begin(), order.begin() + maxSegs, order.end(), LargerSegment(areas));
+		std::vector<bool> kept(numSegs, false);
+		for (int i = 0; i < maxSegs; i++)
+			kept[order[i]] = true;
+		slots.assign(numSegs, -1);
+		int numKept = 0;
+		for (int i = 0; i < numSegs; i++) {
+			if (kept[i])
+				slots[i] = numKept++;
+		}
+		return numKept;
+	}
 
-			float indices[5] = { (float)imgNum, pB->x, pB->y, pB->width, pB->height };
-			caffe_copy(5, (Dtype *)indices, (Dtype *)seg_data + top[0]->offset(currSeg, 0, 0, 0));
-
-			//*pSL++ = (float)MostOccuringValue(label, *pB);
-			if (labelsProvided)
-				label_data[currSeg] = static_cast<float>(MostOccuringValue(label, *pB));
-			//Then we will extract it and add it to the top blob
-			/*cv::Mat sub1 = in[0](*pB);
-			cv::Mat sub2 = in[1](*pB);
-			cv::Mat sub3 = in[2](*pB);
-			cv::resize(sub1, sub1, cv::Size(segWidth, segHeight));
-			cv::resize(sub2, sub2, cv::Size(segWidth, segHeight));
-			cv::resize(sub3, sub3, cv::Size(segWidth, segHeight));*/
-			//memcpy((Dtype *)seg_data + top[0]->offset(currSeg, 0, 0, 0), (Dtype *)sub1.data, sizeof(Dtype)* size);
-			/*if (error != cudaSuccess)
-				printf("Cuda copy error: %s", cudaGetErrorString(error));*/
-			//memcpy((Dtype *)seg_data + top[0]->offset(currSeg, 1, 0, 0), (Dtype *)sub2.data, sizeof(Dtype)* size);
-			//memcpy((Dtype *)seg_data + top[0]->offset(currSeg, 2, 0, 0), (Dtype *)sub3.data, sizeof(Dtype)* size);
-			/*caffe_copy(size, (Dtype *)sub1.data, (Dtype *)seg_data + top[0]->offset(currSeg, 0, 0, 0));
-			caffe_copy(size, (Dtype *)sub2.data, (Dtype *)seg_data + top[0]->offset(currSeg, 1, 0, 0));
-			caffe_copy(size, (Dtype *)sub3.data, (Dtype *)seg_data + top[0]->offset(currSeg, 2, 0, 0));*/
-			/*caffe_copy(size, bottom_data[bottom[0]->offset(imgNum, 0, pB->y, pB->x)], seg_data[top[0]->offset(currSeg, 0, 0, 0)]);
-			caffe_copy(size, bottom_data[bottom[0]->offset(imgNum, 1, pB->y, pB->x)], seg_data[top[0]->offset(currSeg, 1, 0, 0)]);
-			caffe_copy(size, bottom_data[bottom[0]->offset(imgNum, 2, pB->y, pB->x)], seg_data[top[0]->offset(currSeg, 2, 0, 0)]);*/
-			//seg_data[top[0]->offset(currSeg, 0, 0, 0)] = sub1.data;
-			//seg_data[top[0]->offset(currSeg, 0, segWidth, segHeight)]->CopyFrom(bottom_data[bottom[0]->offset(imgNum, 0, pB->y, pB->x)];
-			//CopyMatToDType(sub1, seg_data + top[0]->offset(currSeg, 1, 0, 0));
-
-		}
-
-		//caffe_copy(numSegs, (Dtype *)segLabels, (Dtype *)label_data + top[1]->offset(currSeg));
-		//free(segLabels);
+	// Writes the [imgNum x1 y1 x2 y2] box of every kept segment of one image
+	// to its slot in seg_data, and its label to label_data when given.
+	template <typename Dtype>
+	void ExtractSegBoxes(const std::vector<cv::Rect> &boxes, const std::vector<int> &slots, const std::vector<int> &modes, const int imgNum, Dtype* seg_data, Dtype* label_data) {
+		for (int i = 0; i < boxes.size(); i++) {
+			if (slots[i] < 0)
+				continue;
+			const cv::Rect &bbox = boxes[i];
+			Dtype* box = seg_data + slots[i] * 5;
+			box[0] = imgNum;
+			box[1] = bbox.x;
+			box[2] = bbox.y;
+			box[3] = bbox.width;
+			box[4] = bbox.height;
+
+			if (label_data)
+				label_data[slots[i]] = modes[i];
+		}
 	}
 
 	template <typename Dtype>
-	int SegmentationLayer<Dtype>::Segmentation(std::vector<cv::Mat> &in, cv::Mat &out, const int segStartNumber) {
+	int SegmentationLayer<Dtype>::Segmentation(std::vector<cv::Mat> &in, cv::Mat &out, const float k, const int segStartNumber) {
 		int numSegs = 0;
 		if (method_ == 0) {
-			cv::Mat tmp;
-      if (max_k_ != 0) {
-        int diff = int(max_k_ - min_k_);
-        k_ = rand() % diff + min_k_;
-      }
-			numSegs = FHGraphSegment(in, smoothing_, k_, min_size_, out, tmp, segStartNumber);
+			// every thread keeps its own scratch memory across images and calls
+			numSegs = FHGraphSegment(in, smoothing_, k, min_size_, out, *fh_arenas_[caffe_omp_thread_num()], segStartNumber);
+		}
+		else if (method_ == 1) {
+			// reference implementation, kept for comparison with method 2
+			cv::Mat merged, img;
+			cv::merge(in, merged);
+			merged.convertTo(img, CV_8UC3);
+			SLIC slic(img.cols, img.rows);
+			cv::Point topLeft(0, 0);
+			slic.ComputeSuperPixels(img, topLeft, s_, m_, iter_);
+			slic.CreateMask(out);
+			std::vector<int> ids;
+			numSegs = RelabelSegments(out.ptr<int>(), out.rows * out.cols, slic.NumCenters(), ids);
 		}
 		else {
-			//cv::Mat merged;
-			//cv::merge(in, merged);
-			//SLIC slic(merged.cols, merged.rows);
-			//slic.ComputeSuperPixels(merged, cv::Point(0, 0), s_, m_, iter_);
-			//cv::Mat tmp;
-			//slic.DrawResults(tmp);
-			//cv::imshow("SLIC", tmp);
-			//cv::waitKey(0);
-			//slic.CreateMask(out);
-			CHECK_EQ(method_, 1) << "Error, SLIC not fully implemented yet.";
+			out.create(in[0].rows, in[0].cols, CV_32SC1);
+			numSegs = slic_engines_[caffe_omp_thread_num()]->Segment(in[0].ptr<float>(),
+				in[1].ptr<float>(), in[2].ptr<float>(), in[0].cols, in[0].rows,
+				s_, m_, iter_, min_center_shift_, slic_threads_, out.ptr<int>());
+		}
+		if (method_ != 0 && segStartNumber != 0) {
+			int *pO = out.ptr<int>();
+			for (int i = 0; i < out.rows * out.cols; i++)
+				pO[i] += segStartNumber;
 		}
 		return numSegs;
 	}
@@ -837,7 +1137,10 @@ namespace caffe {
 	void SegmentationLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 		const vector<Blob<Dtype>*>& top) {
 		SegmentationParameter seg_param = this->layer_param_.seg_param();
-		num_segments_ = 100;
+		max_segments_ = seg_param.max_segments();
+		// The real count is only known after segmenting, so start from one
+		// segment per image (or the cap) and resize the tops every forward.
+		num_segments_ = max_segments_ > 0 ? max_segments_ * bottom[0]->num() : bottom[0]->num();
 		//data_height_ = seg_param.data_height();
 		//data_width_ = seg_param.data_width();
 		bbox_extension_ = seg_param.bbox_extension();
@@ -850,11 +1153,12 @@ namespace caffe {
 		s_ = seg_param.s();
 		m_ = seg_param.m();
 		iter_ = seg_param.iter();
+		min_center_shift_ = seg_param.min_center_shift();
 
     srand((unsigned int)time(NULL));
 
-		CHECK_LT(method_, 2) << "Method must be 0 (FH - default) or 1 (SLIC)";
-		CHECK_GT(method_, -1) << "Method must be 0 (FH - default) or 1 (SLIC)";
+		CHECK_LT(method_, 3) << "Method must be 0 (FH - default), 1 (SLIC) or 2 (fast SLIC)";
+		CHECK_GT(method_, -1) << "Method must be 0 (FH - default), 1 (SLIC) or 2 (fast SLIC)";
 		CHECK_GE(bbox_extension_, 0) << "Bounding box extension must be 0 or greater";
 		CHECK_GE(smoothing_, 0) << "Smoothing must be 0 or greater";
 		CHECK_GE(k_, 0) << "k must be greater than 0";
@@ -870,20 +1174,23 @@ namespace caffe {
 		CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
 			<< "corresponding to (num, channels, height, width)";
 
-		//vector<int> top_shape = bottom[0]->shape();
-		//Guess the number of segs here here
-		//top_shape[0] = top_shape[0] * 60;
+		// num_segments_ is the count of the last forward pass; Forward_cpu
+		// resizes the tops again once the new images are segmented.
+		const int num = bottom[0]->num();
+		const int height = bottom[0]->height();
+		const int width = bottom[0]->width();
 		top[0]->Reshape(num_segments_, 5, 1, 1);
+		seg_ids_.Reshape(num, 1, height, width);
 		if (top.size() == 2) {
       if(bottom.size() == 2) {
 		    CHECK_EQ(4, bottom[1]->num_axes()) << "Label must have 4 axes, "
 		 	    << "corresponding to (num, channels, height, width)";
         top[1]->Reshape(num_segments_, 1, 1, 1);
       } else
-        top[1]->ReshapeLike(*(bottom[0]));
+        top[1]->Reshape(num, 1, height, width);
     } else if (top.size() == 3) {
       top[1]->Reshape(num_segments_, 1, 1, 1);
-      top[2]->ReshapeLike(*(bottom[0]));
+      top[2]->Reshape(num, 1, height, width);
     }
 
 	}
@@ -941,45 +1248,114 @@ namespace caffe {
 		}
 		}*/
 		vector<int> shape = bottom[0]->shape();
-		int num = shape[2] * shape[3];
-		std::vector<cv::Mat> channels;
-    channels.resize(3);
-		cv::Mat img;
-		int segId = 0;
-		this->num_segments_ = 0;
+		const int num_images = shape[0];
+		const int num = shape[2] * shape[3];
 
 		bool labelsProvided = false;
 		if (bottom.size() == 2)
 			labelsProvided = true;
 		bool genSegs = false;
-		Dtype* top_seg_data;
-		if ((top.size() == 2 && !labelsProvided) || top.size() == 3) {
+		if ((top.size() == 2 && !labelsProvided) || top.size() == 3)
 			genSegs = true;
+
+		// Draw the per-image FH scale up front so that the images can be
+		// segmented concurrently and still see the same sequence of k.
+		std::vector<float> ks(num_images, k_);
+		if (method_ == 0 && max_k_ != 0) {
+			int diff = int(max_k_ - min_k_);
+			for (int i = 0; i < num_images; i++)
+				ks[i] = rand() % diff + min_k_;
+		}
+
+		// Segment every image independently, with segment ids local to it
+		const Dtype* bottom_data = bottom[0]->cpu_data();
+		while (fh_arenas_.size() < caffe_omp_max_threads())
+			fh_arenas_.push_back(shared_ptr<FHArena>(new FHArena()));
+		while (slic_engines_.size() < caffe_omp_max_threads())
+			slic_engines_.push_back(shared_ptr<FastSLIC>(new FastSLIC()));
+		// The backends read the planes of bottom[0] and write the segment ids
+		// to seg_ids_ through Mat headers, without copying either.
+		int* seg_ids = seg_ids_.mutable_cpu_data();
+		std::vector<cv::Mat> segs(num_images);
+		std::vector<int> seg_counts(num_images, 0);
+		// Images run on the threads in parallel, except that FastSLIC spreads
+		// each image over all of them when the batch cannot keep them busy.
+		// Nesting both levels would only run the inner one on one thread.
+		const int num_threads = caffe_omp_max_threads();
+		const bool parallel_images = method_ != 2 || num_images >= num_threads;
+		slic_threads_ = parallel_images ? 1 : num_threads;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (parallel_images)
+#endif
+		for (int i = 0; i < num_images; i++) {
+			std::vector<cv::Mat> channels(3);
+			for (int c = 0; c < 3; c++)
+				channels[c] = cv::Mat(shape[2], shape[3], CV_32FC1, (void*)(bottom_data + bottom[0]->offset(i, c, 0, 0)));
+			segs[i] = cv::Mat(shape[2], shape[3], CV_32SC1, seg_ids + seg_ids_.offset(i));
+			seg_counts[i] = Segmentation(channels, segs[i], ks[i], 0);
+		}
+
+		// Boxes and areas of every segment, keeping only the largest ones if
+		// the number of segments per image is capped
+		const Dtype* label_data = labelsProvided ? bottom[1]->cpu_data() : NULL;
+		std::vector<std::vector<cv::Rect> > boxes(num_images);
+		std::vector<std::vector<int> > slots(num_images);
+		std::vector<std::vector<int> > modes(num_images);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int i = 0; i < num_images; i++) {
+			std::vector<int> areas;
+			ComputeSegBoxes(segs[i], labelsProvided ? label_data + bottom[1]->offset(i) : NULL,
+				seg_counts[i], bbox_extension_, boxes[i], areas, modes[i]);
+			seg_counts[i] = SelectSegments(areas, max_segments_, slots[i]);
+		}
+
+		// The offset of each image's first segment is the prefix sum of the
+		// counts before it, so the scatter below is independent of scheduling.
+		std::vector<int> seg_offsets(num_images + 1, 0);
+		for (int i = 0; i < num_images; i++)
+			seg_offsets[i + 1] = seg_offsets[i] + seg_counts[i];
+		this->num_segments_ = seg_offsets[num_images];
+
+		// Size the tops to the segments actually found, so that the layers
+		// consuming the boxes only see real ones
+		top[0]->Reshape(num_segments_, 5, 1, 1);
+		Dtype* top_box_data = top[0]->mutable_cpu_data();
+		Dtype* top_label_data = NULL;
+		if (labelsProvided) {
+			top[1]->Reshape(num_segments_, 1, 1, 1);
+			top_label_data = top[1]->mutable_cpu_data();
+		}
+		Dtype* top_seg_data = NULL;
+		if (genSegs) {
+			top.back()->Reshape(num_images, 1, shape[2], shape[3]);
 			top_seg_data = top.back()->mutable_cpu_data();
-			//std::vector<int> top_shape = { shape[0], 1, shape[2], shape[3] };
-			top.back()->Reshape(shape[0], 1, shape[2], shape[3]);
-		}
-		for (int i = 0; i < shape[0]; i++) {
-			channels[0] = cv::Mat(shape[2], shape[3], CV_32FC1, (void*)(bottom[0]->cpu_data() + bottom[0]->offset(i, 0, 0, 0)));
-			channels[1] = cv::Mat(shape[2], shape[3], CV_32FC1, (void*)(bottom[0]->cpu_data() + bottom[0]->offset(i, 1, 0, 0)));
-			channels[2] = cv::Mat(shape[2], shape[3], CV_32FC1, (void*)(bottom[0]->cpu_data() + bottom[0]->offset(i, 2, 0, 0)));
-			cv::merge(channels, img);
-
-			cv::Mat label;
-			if (labelsProvided)
-				label = cv::Mat(shape[2], shape[3], CV_32FC1, (void*)(bottom[1]->cpu_data() + bottom[1]->offset(i, 0, 0, 0)));
-			//img.convertTo(img, CV_8UC3);
-			cv::Mat seg;
-			int numSegs = Segmentation(channels, seg, segId);
-			this->num_segments_ += numSegs;
-			ExtractSegBoxes<Dtype>(channels, seg, label, numSegs, segId, i, bbox_extension_, bottom, top, labelsProvided);
-
-			//If the user wants the segmentation
+		}
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int i = 0; i < num_images; i++) {
+			if (seg_counts[i] == 0) {
+				if (genSegs)
+					caffe_set(num, Dtype(-1), top_seg_data + top.back()->offset(i, 0, 0, 0));
+				continue;
+			}
+			ExtractSegBoxes<Dtype>(boxes[i], slots[i], modes[i], i,
+				top_box_data + seg_offsets[i] * 5,
+				labelsProvided ? top_label_data + seg_offsets[i] : NULL);
+
+			//If the user wants the segmentation, pixels of dropped segments are -1
 			if (genSegs) {
-				seg.convertTo(seg, CV_32FC1);
-				caffe_copy(num, (Dtype *)seg.data, (Dtype *)top_seg_data + top.back()->offset(i, 0, 0, 0));
+				const int* pS = segs[i].ptr<int>();
+				const std::vector<int> &slot = slots[i];
+				Dtype* pT = top_seg_data + top.back()->offset(i, 0, 0, 0);
+				for (int j = 0; j < num; j++) {
+					const int s = slot[pS[j]];
+					pT[j] = s < 0 ? Dtype(-1) : static_cast<Dtype>(s + seg_offsets[i]);
+				}
 			}
-			segId += numSegs;
 		}
 		//cv::Mat tmp = DecodeDatumToCVMat(*(const caffe::Datum*)((bottom[0]->cpu_data())), true);
 		//caffe_copy(num, bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
@@ -5,7 +5,11 @@
 // Licensed under The MIT License [see LICENSE for details]
 // --------------------------------------------------------
 
+#include <cmath>
+#include <vector>
+
 #include "caffe/layers/smooth_L1_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -51,13 +55,62 @@ void SmoothL1LossLayer<Dtype>::Reshape(
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  // f(x)  = 0.5 * (sigma * x)^2          if |x| < 1 / sigma / sigma
+  //         |x| - 0.5 / sigma / sigma    otherwise
+  // f'(x) = sigma * sigma * x            if |x| < 1 / sigma / sigma
+  //         sign(x)                      otherwise
+  // Unlike the GPU path, which makes one pass per operation, a single pass
+  // computes x = w_in * (b0 - b1), accumulates w_out * f(x), and leaves
+  // w_out * w_in * f'(x) in diff_ so that Backward is a plain scaling.
+  const int count = bottom[0]->count();
+  const Dtype* b0 = bottom[0]->cpu_data();
+  const Dtype* b1 = bottom[1]->cpu_data();
+  const Dtype* inside_weights = has_weights_ ? bottom[2]->cpu_data() : NULL;
+  const Dtype* outside_weights = has_weights_ ? bottom[3]->cpu_data() : NULL;
+  Dtype* diff = diff_.mutable_cpu_data();
+  const Dtype sigma2 = sigma2_;
+  const Dtype inv_sigma2 = Dtype(1) / sigma2;
+  Dtype loss = 0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+: loss)
+#endif
+  for (int i = 0; i < count; ++i) {
+    Dtype val = b0[i] - b1[i];
+    if (has_weights_) {
+      val *= inside_weights[i];
+    }
+    const Dtype abs_val = std::fabs(val);
+    Dtype error, gradient;
+    if (abs_val < inv_sigma2) {
+      error = Dtype(0.5) * val * val * sigma2;
+      gradient = sigma2 * val;
+    } else {
+      error = abs_val - Dtype(0.5) * inv_sigma2;
+      gradient = (Dtype(0) < val) - (val < Dtype(0));
+    }
+    if (has_weights_) {
+      error *= outside_weights[i];
+      gradient *= inside_weights[i] * outside_weights[i];
+    }
+    loss += error;
+    diff[i] = gradient;
+  }
+  top[0]->mutable_cpu_data()[0] = loss / bottom[0]->num();
 }
 
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  // after Forward_cpu, diff_ holds w_out * w_in * f'(w_in * (b0 - b1))
+  const int count = diff_.count();
+  for (int i = 0; i < 2; ++i) {
+    if (propagate_down[i]) {
+      const Dtype sign = (i == 0) ? 1 : -1;
+      const Dtype alpha = sign * top[0]->cpu_diff()[0] / bottom[i]->num();
+      caffe_cpu_scale(count, alpha, diff_.cpu_data(),
+          bottom[i]->mutable_cpu_diff());
+    }
+  }
 }
 
 #ifdef CPU_ONLY
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The transforms of F(m x m, 3 x 3) from Lavin and Gray, "Fast Algorithms for
+// Convolutional Neural Networks": the input transform B^T, (m + 2) x (m + 2),
+// the filter transform G, (m + 2) x 3, and the output transform A^T,
+// m x (m + 2).
+struct WinogradTransforms {
+  const double* input;
+  const double* filter;
+  const double* output;
+};
+
+static const double kInputTransform2[] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1,
+};
+static const double kFilterTransform2[] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1,
+};
+static const double kOutputTransform2[] = {
+  1, 1,  1,  0,
+  0, 1, -1, -1,
+};
+
+static const double kInputTransform4[] = {
+  4,  0, -5,  0, 1, 0,
+  0, -4, -4,  1, 1, 0,
+  0,  4, -4, -1, 1, 0,
+  0, -2, -1,  2, 1, 0,
+  0,  2, -1, -2, 1, 0,
+  0,  4,  0, -5, 0, 1,
+};
+static const double kFilterTransform4[] = {
+  1. / 4,        0,      0,
+  -1. / 6,  -1. / 6, -1. / 6,
+  -1. / 6,   1. / 6, -1. / 6,
+  1. / 24,  1. / 12,  1. / 6,
+  1. / 24, -1. / 12,  1. / 6,
+  0,              0,      1,
+};
+static const double kOutputTransform4[] = {
+  1, 1,  1, 1,  1, 0,
+  0, 1, -1, 2, -2, 0,
+  0, 1,  1, 4,  4, 0,
+  0, 1, -1, 8, -8, 1,
+};
+
+static WinogradTransforms winograd_transforms(int tile) {
+  WinogradTransforms transforms;
+  if (tile == 2) {
+    transforms.input = kInputTransform2;
+    transforms.filter = kFilterTransform2;
+    transforms.output = kOutputTransform2;
+  } else {
+    CHECK_EQ(tile, 4) << "Unsupported Winograd tile size";
+    transforms.input = kInputTransform4;
+    transforms.filter = kFilterTransform4;
+    transforms.output = kOutputTransform4;
+  }
+  return transforms;
+}
+
+// The largest tile of the transformed domain, (4 + 2) x (4 + 2).
+static const int kMaxTransformedTile = 36;
+// The number of tiles transformed together. The tiles are the innermost
+// dimension of the blocks, so that the transforms vectorize over them.
+static const int kTileBlock = 16;
+
+// c = a * b for a rows x inner transform a and an inner x cols matrix b of
+// tile blocks.
+template <typename Dtype>
+inline void transform_left(const double* a, const Dtype* b, const int rows,
+    const int inner, const int cols, Dtype* c) {
+  std::fill(c, c + rows * cols * kTileBlock, Dtype(0));
+  for (int i = 0; i < rows; ++i) {
+    for (int k = 0; k < inner; ++k) {
+      const Dtype coefficient = a[i * inner + k];
+      if (coefficient == 0) {
+        continue;
+      }
+      for (int j = 0; j < cols; ++j) {
+        Dtype* c_block = c + (i * cols + j) * kTileBlock;
+        const Dtype* b_block = b + (k * cols + j) * kTileBlock;
+        for (int t = 0; t < kTileBlock; ++t) {
+          c_block[t] += coefficient * b_block[t];
+        }
+      }
+    }
+  }
+}
+
+// c = b * a^T for a rows x inner matrix b of tile blocks and a cols x inner
+// transform a.
+template <typename Dtype>
+inline void transform_right(const Dtype* b, const double* a, const int rows,
+    const int inner, const int cols, Dtype* c) {
+  std::fill(c, c + rows * cols * kTileBlock, Dtype(0));
+  for (int j = 0; j < cols; ++j) {
+    for (int k = 0; k < inner; ++k) {
+      const Dtype coefficient = a[j * inner + k];
+      if (coefficient == 0) {
+        continue;
+      }
+      for (int i = 0; i < rows; ++i) {
+        Dtype* c_block = c + (i * cols + j) * kTileBlock;
+        const Dtype* b_block = b + (i * inner + k) * kTileBlock;
+        for (int t = 0; t < kTileBlock; ++t) {
+          c_block[t] += coefficient * b_block[t];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // The tile is chosen before the base class sizes the workspace.
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  tile_ = 0;
+  winograd_workspace_ = 0;
+  if (this->num_spatial_axes_ == 2 &&
+      kernel_shape[0] == 3 && kernel_shape[1] == 3 &&
+      stride[0] == 1 && stride[1] == 1 &&
+      dilation[0] == 1 && dilation[1] == 1) {
+    const int output_h =
+        bottom[0]->shape(this->channel_axis_ + 1) + 2 * pad[0] - 2;
+    const int output_w =
+        bottom[0]->shape(this->channel_axis_ + 2) + 2 * pad[1] - 2;
+    tile_ = std::min(output_h, output_w) >= 8 ? 4 : 2;
+    const int tiles = ((output_h + tile_ - 1) / tile_) *
+        ((output_w + tile_ - 1) / tile_);
+    winograd_workspace_ = (tile_ + 2) * (tile_ + 2) * tiles *
+        (this->channels_ + this->num_output_) / this->group_ * sizeof(Dtype);
+  }
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::transform_weights() {
+  // Checked first, so that the snapshot stays up to date
+  if (!this->weights_changed(&weight_snapshot_) &&
+      tile_ == transformed_tile_) {
+    return;
+  }
+  const WinogradTransforms transforms = winograd_transforms(tile_);
+  const int alpha = tile_ + 2;
+  const int channels = this->channels_ / this->group_;
+  const int output_channels = this->num_output_ / this->group_;
+  vector<int> shape(4);
+  shape[0] = this->group_;
+  shape[1] = alpha * alpha;
+  shape[2] = output_channels;
+  shape[3] = channels;
+  transformed_weights_.Reshape(shape);
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* transformed = transformed_weights_.mutable_cpu_data();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int oc = 0; oc < this->num_output_; ++oc) {
+    const int g = oc / output_channels;
+    const int k = oc % output_channels;
+    // The filters of kTileBlock input channels are transformed together
+    Dtype filter[9 * kTileBlock];
+    Dtype partial[kMaxTransformedTile * kTileBlock];
+    Dtype u[kMaxTransformedTile * kTileBlock];
+    for (int c0 = 0; c0 < channels; c0 += kTileBlock) {
+      const int block = std::min(kTileBlock, channels - c0);
+      std::fill(filter, filter + 9 * kTileBlock, Dtype(0));
+      for (int j = 0; j < 9; ++j) {
+        for (int c = 0; c < block; ++c) {
+          filter[j * kTileBlock + c] = weight[(oc * channels + c0 + c) * 9 + j];
+        }
+      }
+      // u = G g G^T
+      transform_left(transforms.filter, filter, alpha, 3, 3, partial);
+      transform_right(partial, transforms.filter, alpha, 3, alpha, u);
+      for (int xi = 0; xi < alpha * alpha; ++xi) {
+        for (int c = 0; c < block; ++c) {
+          transformed[((g * alpha * alpha + xi) * output_channels + k) *
+              channels + c0 + c] = u[xi * kTileBlock + c];
+        }
+      }
+    }
+  }
+  transformed_tile_ = tile_;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!tile_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  transform_weights();
+  // The GEMMs of the tile elements are spread over the threads already
+  BlasSingleThread blas_thread(caffe_omp_max_threads() > 1);
+  const WinogradTransforms transforms = winograd_transforms(tile_);
+  const int m = tile_;
+  const int alpha = m + 2;
+  const int alpha2 = alpha * alpha;
+  const int* pad = this->pad_.cpu_data();
+  const int channels = this->channels_ / this->group_;
+  const int output_channels = this->num_output_ / this->group_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int tiles_w = (output_w + m - 1) / m;
+  const int tiles = (output_h + m - 1) / m * tiles_w;
+  // alpha2 x channels x tiles, then alpha2 x output_channels x tiles
+  Dtype* transformed_input = this->cpu_col_buffers();
+  Dtype* transformed_output = transformed_input + alpha2 * channels * tiles;
+  const Dtype* transformed_weights = transformed_weights_.cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      for (int g = 0; g < this->group_; ++g) {
+        const Dtype* input = bottom_data + n * this->bottom_dim_ +
+            g * channels * height * width;
+        Dtype* output = top_data + n * this->top_dim_ +
+            g * output_channels * output_h * output_w;
+        // V = B^T d B for every input tile d
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (int c = 0; c < channels; ++c) {
+          const Dtype* input_channel = input + c * height * width;
+          Dtype d[kMaxTransformedTile * kTileBlock];
+          Dtype partial[kMaxTransformedTile * kTileBlock];
+          Dtype v[kMaxTransformedTile * kTileBlock];
+          for (int t0 = 0; t0 < tiles; t0 += kTileBlock) {
+            const int block = std::min(kTileBlock, tiles - t0);
+            for (int b = 0; b < kTileBlock; ++b) {
+              const int t = t0 + std::min(b, block - 1);
+              const int h0 = t / tiles_w * m - pad[0];
+              const int w0 = t % tiles_w * m - pad[1];
+              for (int y = 0; y < alpha; ++y) {
+                for (int x = 0; x < alpha; ++x) {
+                  const int h = h0 + y;
+                  const int w = w0 + x;
+                  d[(y * alpha + x) * kTileBlock + b] = (h >= 0 && h < height
+                      && w >= 0 && w < width) ? input_channel[h * width + w] :
+                      Dtype(0);
+                }
+              }
+            }
+            transform_left(transforms.input, d, alpha, alpha, alpha, partial);
+            transform_right(partial, transforms.input, alpha, alpha, alpha, v);
+            for (int xi = 0; xi < alpha2; ++xi) {
+              Dtype* transformed_tiles =
+                  transformed_input + (xi * channels + c) * tiles + t0;
+              for (int b = 0; b < block; ++b) {
+                transformed_tiles[b] = v[xi * kTileBlock + b];
+              }
+            }
+          }
+        }
+        // M = U V for every element of the transformed tile
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (int xi = 0; xi < alpha2; ++xi) {
+          caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, output_channels,
+              tiles, channels, (Dtype)1.,
+              transformed_weights + (g * alpha2 + xi) * output_channels *
+              channels, transformed_input + xi * channels * tiles,
+              (Dtype)0., transformed_output + xi * output_channels * tiles);
+        }
+        // Y = A^T M A for every output tile
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (int k = 0; k < output_channels; ++k) {
+          Dtype* output_channel = output + k * output_h * output_w;
+          const Dtype bias_value =
+              bias ? bias[g * output_channels + k] : Dtype(0);
+          Dtype transformed_tiles[kMaxTransformedTile * kTileBlock];
+          Dtype partial[kMaxTransformedTile * kTileBlock];
+          Dtype y[kMaxTransformedTile * kTileBlock];
+          for (int t0 = 0; t0 < tiles; t0 += kTileBlock) {
+            const int block = std::min(kTileBlock, tiles - t0);
+            for (int xi = 0; xi < alpha2; ++xi) {
+              const Dtype* source =
+                  transformed_output + (xi * output_channels + k) * tiles + t0;
+              for (int b = 0; b < kTileBlock; ++b) {
+                transformed_tiles[xi * kTileBlock + b] =
+                    source[std::min(b, block - 1)];
+              }
+            }
+            transform_left(transforms.output, transformed_tiles, m, alpha,
+                alpha, partial);
+            transform_right(partial, transforms.output, m, alpha, m, y);
+            for (int b = 0; b < block; ++b) {
+              const int h0 = (t0 + b) / tiles_w * m;
+              const int w0 = (t0 + b) % tiles_w * m;
+              for (int dy = 0; dy < m && h0 + dy < output_h; ++dy) {
+                for (int dx = 0; dx < m && w0 + dx < output_w; ++dx) {
+                  output_channel[(h0 + dy) * output_w + w0 + dx] =
+                      y[(dy * m + dx) * kTileBlock + b] + bias_value;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
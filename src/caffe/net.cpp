@@ -251,10 +251,172 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  ShareWorkspace();
   debug_info_ = param.debug_info();
+  // Backward needs every activation, so sharing is for inference only.
+  share_activations_ = param.share_activations() && phase_ == TEST &&
+      !param.force_backward();
+  LOG_IF(INFO, param.share_activations() && !share_activations_ &&
+      Caffe::root_solver())
+      << "Ignoring share_activations: it needs the TEST phase and no "
+      << "force_backward";
+  if (share_activations_) {
+    PlanActivations();
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::ShareWorkspace() {
+  size_t workspace_size = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    workspace_size = std::max(workspace_size, layers_[i]->WorkspaceSize());
+  }
+  if (workspace_size == 0) {
+    workspace_.reset();
+    return;
+  }
+  // Sized to the current shapes, so it also shrinks
+  if (!workspace_ || workspace_->size() != workspace_size) {
+    workspace_.reset(new SyncedMemory(workspace_size));
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Memory required for the layer workspace: " << workspace_size;
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layers_[i]->WorkspaceSize() > 0) {
+      layers_[i]->SetWorkspace(workspace_);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanActivations() {
+  // Group the blobs by memory, with the first and last layer using each group.
+  // Memory also held outside of the net's blobs, like the tops of recurrent
+  // layers, cannot be moved.
+  map<SyncedMemory*, int> memory_refs;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() > 0) {
+      ++memory_refs[blobs_[blob_id]->data().get()];
+    }
+  }
+  map<SyncedMemory*, int> memory_to_group;
+  vector<int> blob_group(blobs_.size(), -1);
+  vector<int> group_begin;
+  vector<int> group_end;
+  vector<size_t> group_size;
+  vector<bool> group_pinned;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < 2; ++i) {
+      const vector<int>& blob_ids =
+          i == 0 ? bottom_id_vecs_[layer_id] : top_id_vecs_[layer_id];
+      for (int j = 0; j < blob_ids.size(); ++j) {
+        const int blob_id = blob_ids[j];
+        const Blob<Dtype>& blob = *blobs_[blob_id];
+        if (blob.count() == 0) { continue; }
+        SyncedMemory* memory = blob.data().get();
+        if (blob_group[blob_id] < 0 && i == 1 &&
+            layers_[layer_id]->ForwardSharesData() &&
+            blob_group[bottom_id_vecs_[layer_id][0]] >= 0) {
+          // Forward will point the top at the bottom's memory
+          blob_group[blob_id] = blob_group[bottom_id_vecs_[layer_id][0]];
+        }
+        if (blob_group[blob_id] < 0) {
+          if (memory_to_group.find(memory) == memory_to_group.end()) {
+            memory_to_group[memory] = group_begin.size();
+            group_begin.push_back(layer_id);
+            group_end.push_back(layer_id);
+            group_size.push_back(0);
+            group_pinned.push_back(false);
+          }
+          blob_group[blob_id] = memory_to_group[memory];
+        }
+        const int group = blob_group[blob_id];
+        if (blob.data().use_count() > memory_refs[memory]) {
+          group_pinned[group] = true;
+        }
+        group_end[group] = layer_id;
+        group_size[group] = std::max(group_size[group],
+            blob.count() * sizeof(Dtype));
+        const bool source = bottom_id_vecs_[layer_id].empty();
+        const bool loss = blob_id < blob_loss_weights_.size() &&
+            blob_loss_weights_[blob_id] != Dtype(0);
+        if (source || loss) { group_pinned[group] = true; }
+      }
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    const int group = blob_group[net_input_blob_indices_[i]];
+    if (group >= 0) { group_pinned[group] = true; }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int group = blob_group[net_output_blob_indices_[i]];
+    if (group >= 0) { group_pinned[group] = true; }
+  }
+  // Groups are numbered in order of their first layer. Give each one the free
+  // arena that fits it most tightly, or else grow the largest free arena.
+  vector<int> group_arena(group_begin.size(), -1);
+  vector<size_t> arena_size;
+  vector<int> arena_end;
+  size_t memory_planned = 0;
+  for (int group = 0; group < group_begin.size(); ++group) {
+    if (group_pinned[group]) {
+      memory_planned += group_size[group];
+      continue;
+    }
+    int best = -1;
+    for (int arena = 0; arena < arena_size.size(); ++arena) {
+      if (arena_end[arena] >= group_begin[group]) { continue; }
+      if (best < 0) {
+        best = arena;
+        continue;
+      }
+      const bool fits = arena_size[arena] >= group_size[group];
+      const bool best_fits = arena_size[best] >= group_size[group];
+      if ((fits && (!best_fits || arena_size[arena] < arena_size[best])) ||
+          (!fits && !best_fits && arena_size[arena] > arena_size[best])) {
+        best = arena;
+      }
+    }
+    if (best < 0) {
+      best = arena_size.size();
+      arena_size.push_back(0);
+      arena_end.push_back(0);
+    }
+    arena_size[best] = std::max(arena_size[best], group_size[group]);
+    arena_end[best] = group_end[group];
+    group_arena[group] = best;
+  }
+  vector<shared_ptr<SyncedMemory> > arenas(arena_size.size());
+  for (int arena = 0; arena < arena_size.size(); ++arena) {
+    arenas[arena].reset(new SyncedMemory(arena_size[arena]));
+    memory_planned += arena_size[arena];
+  }
+  shared_blob_ids_.clear();
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = blob_group[blob_id];
+    if (group >= 0 && group_arena[group] >= 0) {
+      blobs_[blob_id]->ShareData(arenas[group_arena[group]]);
+      shared_blob_ids_.push_back(blob_id);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory required for data with shared activations: "
+      << memory_planned << " in " << arenas.size() << " shared arenas";
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseActivations() {
+  for (int i = 0; i < shared_blob_ids_.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[shared_blob_ids_[i]].get();
+    if (blob->count() > 0) {
+      blob->ShareData(shared_ptr<SyncedMemory>(
+          new SyncedMemory(blob->count() * sizeof(Dtype))));
+    }
+  }
+  shared_blob_ids_.clear();
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -565,6 +727,8 @@ const vector<Blob<Dtype>*>& Net<Dtype>::Forward(
 
 template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
+  CHECK(!share_activations_)
+      << "Backward needs the activations that share_activations overwrites";
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
@@ -724,9 +888,14 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  // Layers share the memory of their blobs again as they reshape, so the
+  // plan is made from scratch.
+  if (share_activations_) { ReleaseActivations(); }
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  ShareWorkspace();
+  if (share_activations_) { PlanActivations(); }
 }
 
 template <typename Dtype>
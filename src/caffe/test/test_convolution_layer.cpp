@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,7 +7,11 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/openmp.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -264,6 +270,114 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolution) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // 3 x 3 x 3 kernel by 2 x 1 output, for each CPU worker
+  const int num_workers = Caffe::mode() == Caffe::CPU ?
+      std::min(2, caffe_omp_max_threads()) : 1;
+  EXPECT_EQ(num_workers * 27 * 2 * sizeof(Dtype), layer->WorkspaceSize());
+  shared_ptr<SyncedMemory> workspace(
+      new SyncedMemory(2 * layer->WorkspaceSize()));
+  layer->SetWorkspace(workspace);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NE(SyncedMemory::UNINITIALIZED, workspace->head());
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+  // 1x1 convolution needs no workspace
+  convolution_param->clear_kernel_size();
+  convolution_param->clear_stride();
+  convolution_param->add_kernel_size(1);
+  layer.reset(new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(0, layer->WorkspaceSize());
+  // Two 64 x 3 x 3 kernel by 128 x 128 output buffers take over 64 MB, so
+  // the images go to one worker. The blobs are never allocated.
+  convolution_param->clear_kernel_size();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  Blob<Dtype> large_bottom(2, 64, 128, 128);
+  vector<Blob<Dtype>*> large_bottom_vec(1, &large_bottom);
+  layer.reset(new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(large_bottom_vec, this->blob_top_vec_);
+  EXPECT_EQ(64 * 9 * 128 * 128 * sizeof(Dtype), layer->WorkspaceSize());
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchParallel) {
+#ifdef _OPENMP
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // Images are split unevenly among the workers
+  Blob<Dtype> bottom(5, 3, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // Forward and backward on 1 and 3 workers
+  const int max_threads = omp_get_max_threads();
+  Blob<Dtype> top[2];
+  Blob<Dtype> bottom_diff[2];
+  Blob<Dtype> weight_diff[2];
+  Blob<Dtype> bias_diff[2];
+  for (int run = 0; run < 2; ++run) {
+    omp_set_num_threads(run == 0 ? 1 : 3);
+    Caffe::set_random_seed(1701);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    vector<Blob<Dtype>*> top_vec(1, &top[run]);
+    layer.SetUp(bottom_vec, top_vec);
+    layer.Forward(bottom_vec, top_vec);
+    caffe_copy(top[run].count(), top[run].cpu_data(),
+        top[run].mutable_cpu_diff());
+    caffe_set(bottom.count(), Dtype(0), bottom.mutable_cpu_diff());
+    layer.Backward(top_vec, vector<bool>(1, true), bottom_vec);
+    bottom_diff[run].CopyFrom(bottom, true, true);
+    weight_diff[run].CopyFrom(*layer.blobs()[0], true, true);
+    bias_diff[run].CopyFrom(*layer.blobs()[1], true, true);
+  }
+  omp_set_num_threads(max_threads);
+  const Blob<Dtype>* results[4][2] = {{&top[0], &top[1]},
+      {&bottom_diff[0], &bottom_diff[1]}, {&weight_diff[0], &weight_diff[1]},
+      {&bias_diff[0], &bias_diff[1]}};
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(results[i][0]->count(), results[i][1]->count());
+    const Dtype* serial = i == 0 ? results[i][0]->cpu_data() :
+        results[i][0]->cpu_diff();
+    const Dtype* parallel = i == 0 ? results[i][1]->cpu_data() :
+        results[i][1]->cpu_diff();
+    for (int j = 0; j < results[i][0]->count(); ++j) {
+      EXPECT_NEAR(serial[j], parallel[j],
+          1e-4 * std::max(Dtype(1), std::abs(serial[j])));
+    }
+  }
+#endif
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestDilatedConvolution) {
   typedef typename TypeParam::Dtype Dtype;
   vector<int> bottom_shape;
@@ -811,6 +925,355 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+// Checks a CPU convolution engine against the reference convolution. The
+// tests of each engine describe the convolution in layer_param_, whose engine
+// and fillers are set up here.
+template <typename Dtype, ConvolutionParameter_Engine kEngine>
+class CPUConvolutionEngineTest : public CPUDeviceTest<Dtype> {
+ protected:
+  CPUConvolutionEngineTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 11, 19)),
+        blob_top_(new Blob<Dtype>()),
+        ref_blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    filler_param.set_value(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    layer_param_.set_type("Convolution");
+    ConvolutionParameter* convolution_param =
+        layer_param_.mutable_convolution_param();
+    convolution_param->set_engine(kEngine);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+  }
+
+  virtual ~CPUConvolutionEngineTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete ref_blob_top_;
+  }
+
+  // Creates the layer of layer_param_ from the registry, which picks the
+  // layer of the engine.
+  shared_ptr<Layer<Dtype> > CreateLayer() {
+    return LayerRegistry<Dtype>::CreateLayer(layer_param_);
+  }
+
+  // Sets up a layer for layer_param_ and checks its output.
+  void TestForward() {
+    shared_ptr<Layer<Dtype> > layer = CreateLayer();
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    CheckForward(layer.get());
+  }
+
+  // Checks the output of layer against the reference convolution, within a
+  // tolerance relative to the magnitude of the output.
+  void CheckForward(Layer<Dtype>* layer) {
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ref_blob_top_->ReshapeLike(*this->blob_top_);
+    // caffe_conv accumulates into its output
+    caffe_set(ref_blob_top_->count(), Dtype(0),
+        ref_blob_top_->mutable_cpu_data());
+    caffe_conv(this->blob_bottom_, layer_param_.mutable_convolution_param(),
+        layer->blobs(), ref_blob_top_);
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i],
+          1e-4 * std::max(Dtype(1), std::fabs(ref_top_data[i])));
+    }
+  }
+
+  // Checks that the output follows changes of the weights of layer after
+  // it has run, as made by loading, a solver step or sharing.
+  void TestWeightChanges(Layer<Dtype>* layer) {
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    CheckForward(layer);
+    // Updated in place
+    caffe_scal(layer->blobs()[0]->count(), Dtype(-2),
+        layer->blobs()[0]->mutable_cpu_data());
+    CheckForward(layer);
+    caffe_add_scalar(layer->blobs()[1]->count(), Dtype(1),
+        layer->blobs()[1]->mutable_cpu_data());
+    CheckForward(layer);
+    // Shared with another layer, as by ShareTrainedLayersWith
+    shared_ptr<Layer<Dtype> > other_layer = CreateLayer();
+    vector<Blob<Dtype>*> other_top_vec(1, this->ref_blob_top_);
+    other_layer->SetUp(this->blob_bottom_vec_, other_top_vec);
+    layer->blobs()[0]->ShareData(*other_layer->blobs()[0]);
+    CheckForward(layer);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const ref_blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+};
+
+template <typename Dtype>
+class DirectConvolutionLayerTest : public CPUConvolutionEngineTest<Dtype,
+    ConvolutionParameter_Engine_DIRECT> {};
+
+TYPED_TEST_CASE(DirectConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(DirectConvolutionLayerTest, TestEngine) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  shared_ptr<Layer<TypeParam> > layer = this->CreateLayer();
+  EXPECT_TRUE(dynamic_cast<DirectConvolutionLayer<TypeParam>*>(layer.get()));
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestSimpleConvolution) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(5);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestDenseConvolution) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(8);
+  EXPECT_DEATH(this->CreateLayer(), "narrow grouped");
+  convolution_param->set_group(2);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestPaddedConvolution) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestStridedConvolution) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(5);
+  convolution_param->set_pad_h(1);
+  convolution_param->set_pad_w(2);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(1);
+  convolution_param->set_num_output(7);
+  this->TestForward();
+  convolution_param->set_stride_h(1);
+  convolution_param->set_stride_w(2);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestDilatedConvolution) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(2);
+  convolution_param->add_dilation(2);
+  convolution_param->set_num_output(4);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, Test1x1Convolution) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(1);
+  convolution_param->set_num_output(7);
+  convolution_param->set_bias_term(false);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestConvolutionGroup) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(14);
+  convolution_param->set_group(2);
+  this->TestForward();
+  convolution_param->set_num_output(4);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestDepthwiseConvolution) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(4);
+  this->TestForward();
+  convolution_param->add_stride(2);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestWeightChanges) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(6);
+  DirectConvolutionLayer<TypeParam> layer(this->layer_param_);
+  this->TestWeightChanges(&layer);
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestWorkspace) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(4);
+  this->blob_bottom_->Reshape(2, 4, 5, 9);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // 4 x 3 x 3 kernel by 5 x 9 output, for each CPU worker
+  const int num_workers = std::min(2, caffe_omp_max_threads());
+  DirectConvolutionLayer<TypeParam> train_layer(this->layer_param_);
+  train_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(num_workers * 36 * 45 * sizeof(TypeParam),
+      train_layer.WorkspaceSize());
+  // Forward only needs the padded input of one image: 4 channels of 7 rows
+  // by the 18 columns that 2 tiles of 8 pixels read
+  this->layer_param_.set_phase(TEST);
+  DirectConvolutionLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(4 * 7 * 18 * sizeof(TypeParam), layer.WorkspaceSize());
+  shared_ptr<SyncedMemory> workspace(new SyncedMemory(layer.WorkspaceSize()));
+  layer.SetWorkspace(workspace);
+  this->CheckForward(&layer);
+  EXPECT_NE(SyncedMemory::UNINITIALIZED, workspace->head());
+  // Backward still gets its column buffers
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestKernelLargerThanInput) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(7);
+  convolution_param->add_pad(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(3);
+  this->blob_bottom_->Reshape(1, 2, 3, 4);
+  this->TestForward();
+}
+
+TYPED_TEST(DirectConvolutionLayerTest, TestGradient) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  this->blob_bottom_->Reshape(2, 3, 5, 9);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  DirectConvolutionLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+template <typename Dtype>
+class WinogradConvolutionLayerTest : public CPUConvolutionEngineTest<Dtype,
+    ConvolutionParameter_Engine_WINOGRAD> {
+ protected:
+  virtual void SetUp() {
+    CPUConvolutionEngineTest<Dtype,
+        ConvolutionParameter_Engine_WINOGRAD>::SetUp();
+    // A convolution the engine takes, unless a test changes it
+    ConvolutionParameter* convolution_param =
+        this->layer_param_.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_pad(1);
+    convolution_param->set_num_output(6);
+  }
+};
+
+TYPED_TEST_CASE(WinogradConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestEngine) {
+  shared_ptr<Layer<TypeParam> > layer = this->CreateLayer();
+  EXPECT_TRUE(
+      dynamic_cast<WinogradConvolutionLayer<TypeParam>*>(layer.get()));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestConvolutionF4x4) {
+  WinogradConvolutionLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(4, layer.tile());
+  this->CheckForward(&layer);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestConvolutionF2x2) {
+  this->blob_bottom_->Reshape(2, 4, 6, 9);
+  WinogradConvolutionLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, layer.tile());
+  this->CheckForward(&layer);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestConvolutionNoPad) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->clear_pad();
+  convolution_param->set_bias_term(false);
+  WinogradConvolutionLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(4, layer.tile());
+  this->CheckForward(&layer);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestConvolutionGroup) {
+  this->layer_param_.mutable_convolution_param()->set_group(2);
+  WinogradConvolutionLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckForward(&layer);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestReshape) {
+  WinogradConvolutionLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckForward(&layer);
+  // The smaller input switches to F(2x2, 3x3) and its filter transform
+  this->blob_bottom_->Reshape(1, 4, 5, 7);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, layer.tile());
+  this->CheckForward(&layer);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestFallback) {
+  ConvolutionParameter* convolution_param =
+      this->layer_param_.mutable_convolution_param();
+  convolution_param->add_stride(2);
+  WinogradConvolutionLayer<TypeParam> strided_layer(this->layer_param_);
+  strided_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(0, strided_layer.tile());
+  this->CheckForward(&strided_layer);
+  convolution_param->clear_stride();
+  convolution_param->set_kernel_size(0, 5);
+  WinogradConvolutionLayer<TypeParam> large_layer(this->layer_param_);
+  large_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(0, large_layer.tile());
+  this->CheckForward(&large_layer);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestWeightChanges) {
+  WinogradConvolutionLayer<TypeParam> layer(this->layer_param_);
+  this->TestWeightChanges(&layer);
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
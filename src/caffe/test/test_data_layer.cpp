@@ -67,7 +67,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  void TestRead(const int readahead = 0, const int readers = 1) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,6 +75,8 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_readahead(readahead);
+    data_param->set_readers(readers);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -105,7 +107,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
-  void TestSkip() {
+  void TestShard(const int readers) {
     LayerParameter param;
     param.set_phase(TRAIN);
     DataParameter* data_param = param.mutable_data_param();
@@ -113,20 +115,43 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(batch_size);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
-    Caffe::set_solver_count(8);
+    data_param->set_readers(readers);
+    Caffe::set_solver_count(2);
+    const int num_records = 5;
+    const int num_shards = Caffe::solver_count() * readers;
+    // Reader r of a solver fills items [r, r + 1) * batch_size / readers,
+    // cycling through shard solver_rank * readers + r.
+    vector<int> reads(num_records, 0);
     for (int dev = 0; dev < Caffe::solver_count(); ++dev) {
       Caffe::set_solver_rank(dev);
       DataLayer<Dtype> layer(param);
       layer.SetUp(blob_bottom_vec_, blob_top_vec_);
-      int label = dev;
+      vector<int> next(readers);
+      for (int r = 0; r < readers; ++r) {
+        next[r] = num_records * (dev * readers + r) / num_shards;
+      }
       for (int iter = 0; iter < 10; ++iter) {
         layer.Forward(blob_bottom_vec_, blob_top_vec_);
-        for (int i = 0; i < batch_size; ++i) {
-          EXPECT_EQ(label % batch_size, blob_top_label_->cpu_data()[i]);
-          label += Caffe::solver_count();
+        for (int r = 0; r < readers; ++r) {
+          const int shard = dev * readers + r;
+          const int begin = num_records * shard / num_shards;
+          const int end = num_records * (shard + 1) / num_shards;
+          for (int i = batch_size * r / readers;
+               i < batch_size * (r + 1) / readers; ++i) {
+            EXPECT_EQ(next[r], blob_top_label_->cpu_data()[i])
+                << "debug: dev " << dev << " iter " << iter << " i " << i;
+            ++reads[next[r]];
+            if (++next[r] == end) {
+              next[r] = begin;
+            }
+          }
         }
       }
     }
+    // The solvers read disjoint shards that cover the database
+    for (int i = 0; i < num_records; ++i) {
+      EXPECT_GT(reads[i], 0) << "record " << i << " never read";
+    }
     Caffe::set_solver_count(1);
     Caffe::set_solver_rank(0);
   }
@@ -362,6 +387,94 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // With device_transform the batches come out as without it
+  void TestDeviceTransform() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(2);
+    transform_param->set_mirror(true);
+    transform_param->set_scale(0.5);
+    transform_param->add_mean_value(3);
+
+    vector<vector<Dtype> > batches;
+    for (int device_transform = 0; device_transform < 2; ++device_transform) {
+      data_param->set_device_transform(device_transform);
+      Caffe::set_random_seed(seed_);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 3; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < 5; ++i) {
+          EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        }
+        const Dtype* data = blob_top_data_->cpu_data();
+        if (!device_transform) {
+          batches.push_back(
+              vector<Dtype>(data, data + blob_top_data_->count()));
+          continue;
+        }
+        ASSERT_EQ(batches[iter].size(), blob_top_data_->count());
+        for (int j = 0; j < blob_top_data_->count(); ++j) {
+          EXPECT_NEAR(batches[iter][j], data[j], 1e-5)
+              << "debug: iter " << iter << " j " << j;
+        }
+      }
+    }
+  }
+
+  // With device_transform a record that does not match the shape of its
+  // batch stops the layer rather than spilling into the next item.
+  void TestDeviceTransformReshape(DataParameter_DB backend) {
+    const int num_inputs = 2;
+    // Save a record larger than the first one in the same batch.
+    LOG(INFO) << "Using temporary dataset " << *filename_;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < num_inputs; ++i) {
+      Datum datum;
+      datum.set_label(i);
+      datum.set_channels(2);
+      datum.set_height(i + 3);
+      datum.set_width(i + 4);
+      std::string* data = datum.mutable_data();
+      const int data_size = datum.channels() * datum.height() * datum.width();
+      for (int j = 0; j < data_size; ++j) {
+        data->push_back(static_cast<uint8_t>(j));
+      }
+      stringstream ss;
+      ss << i;
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(ss.str(), out);
+    }
+    txn->Commit();
+    db->Close();
+
+    LayerParameter param;
+    param.set_phase(TEST);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(num_inputs);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend);
+    data_param->set_device_transform(true);
+
+    // The batch is loaded by the prefetch thread.
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_DEATH({
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    }, "Check failed");
+  }
+
   virtual ~DataLayerTest() { delete blob_top_data_; delete blob_top_label_; }
 
   DataParameter_DB backend_;
@@ -382,15 +495,36 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
-TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
+TYPED_TEST(DataLayerTest, TestReadReadersLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestRead(0, 2);
+}
+
+TYPED_TEST(DataLayerTest, TestDeviceTransformLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestDeviceTransform();
+}
+
+TYPED_TEST(DataLayerTest, TestShardLevelDB) {
   this->Fill(false, DataParameter_DB_LEVELDB);
-  this->TestSkip();
+  this->TestShard(1);
+}
+
+TYPED_TEST(DataLayerTest, TestShardReadersLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestShard(2);
 }
 
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
 
+TYPED_TEST(DataLayerTest, TestDeviceTransformReshapeLevelDB) {
+  this->TestDeviceTransformReshape(DataParameter_DB_LEVELDB);
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLevelDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
@@ -427,15 +561,42 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
-TYPED_TEST(DataLayerTest, TestSkipLMDB) {
+TYPED_TEST(DataLayerTest, TestReadLMDBReadahead) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead(3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadReadersLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead(0, 2);
+}
+
+TYPED_TEST(DataLayerTest, TestDeviceTransformLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestDeviceTransform();
+}
+
+TYPED_TEST(DataLayerTest, TestShardLMDB) {
   this->Fill(false, DataParameter_DB_LMDB);
-  this->TestSkip();
+  this->TestShard(1);
+}
+
+TYPED_TEST(DataLayerTest, TestShardReadersLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestShard(2);
 }
 
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
 
+TYPED_TEST(DataLayerTest, TestDeviceTransformReshapeLMDB) {
+  this->TestDeviceTransformReshape(DataParameter_DB_LMDB);
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLMDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LMDB);
@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -9,7 +10,9 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_view.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -340,5 +343,150 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+// Checks crop, mirror, mean file and scale together, for uint8 and float
+// data, against the transform computed pixel by pixel.
+TYPED_TEST(DataTransformTest, TestCropMirrorMeanFileScale) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int height = 7;
+  const int width = 9;
+  const int crop_size = 5;
+  const TypeParam scale = 0.25;
+
+  string mean_file;
+  MakeTempFilename(&mean_file);
+  BlobProto blob_mean;
+  blob_mean.set_num(1);
+  blob_mean.set_channels(channels);
+  blob_mean.set_height(height);
+  blob_mean.set_width(width);
+  for (int j = 0; j < channels * height * width; ++j) {
+    blob_mean.add_data(j % 7);
+  }
+  WriteProtoToBinaryFile(blob_mean, mean_file);
+  transform_param.set_mean_file(mean_file);
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(scale);
+
+  Datum datum;
+  FillDatum(0, channels, height, width, true, &datum);
+  Datum float_datum(datum);
+  float_datum.clear_data();
+  for (int j = 0; j < channels * height * width; ++j) {
+    float_datum.add_float_data(0.5 * j);
+  }
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    for (int use_float = 0; use_float < 2; ++use_float) {
+      const Datum& input = use_float ? float_datum : datum;
+      transformer.Transform(input, &blob);
+      // Find the crop and mirroring among all the possible ones
+      int num_found = 0;
+      for (int h_off = 0; h_off <= height - crop_size; ++h_off) {
+        for (int w_off = 0; w_off <= width - crop_size; ++w_off) {
+          for (int mirror = 0; mirror < 2; ++mirror) {
+            bool same = true;
+            for (int c = 0; c < channels; ++c) {
+              for (int h = 0; h < crop_size; ++h) {
+                for (int w = 0; w < crop_size; ++w) {
+                  const int index =
+                      (c * height + h_off + h) * width + w_off + w;
+                  const TypeParam pixel = use_float ?
+                      input.float_data(index) :
+                      static_cast<uint8_t>(input.data()[index]);
+                  const TypeParam expected =
+                      (pixel - blob_mean.data(index)) * scale;
+                  const int top_w = mirror ? crop_size - 1 - w : w;
+                  same &= expected ==
+                      blob.data_at(0, c, h, top_w);
+                }
+              }
+            }
+            num_found += same;
+          }
+        }
+      }
+      EXPECT_EQ(1, num_found) << "iter " << iter << " float " << use_float;
+    }
+  }
+}
+
+// CropRaw followed by TransformRaw gives what Transform gives, random crops
+// and mirroring included.
+TYPED_TEST(DataTransformTest, TestTransformRaw) {
+  const int num = 4;
+  const int channels = 3;
+  const int height = 6;
+  const int width = 7;
+  const int crop_size = 4;
+  string mean_file;
+  MakeTempFilename(&mean_file);
+  BlobProto blob_mean;
+  blob_mean.set_num(1);
+  blob_mean.set_channels(channels);
+  blob_mean.set_height(height);
+  blob_mean.set_width(width);
+  for (int j = 0; j < channels * height * width; ++j) {
+    blob_mean.add_data(j % 5);
+  }
+  WriteProtoToBinaryFile(blob_mean, mean_file);
+  for (int mean = 0; mean < 3; ++mean) {
+    TransformationParameter transform_param;
+    transform_param.set_crop_size(crop_size);
+    transform_param.set_mirror(true);
+    transform_param.set_scale(0.5);
+    if (mean == 1) {
+      transform_param.add_mean_value(3);
+    } else if (mean == 2) {
+      transform_param.set_mean_file(mean_file);
+    }
+    DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+    DataTransformer<TypeParam> raw_transformer(transform_param, TRAIN);
+    Caffe::set_random_seed(this->seed_);
+    transformer.InitRand();
+    Caffe::set_random_seed(this->seed_);
+    raw_transformer.InitRand();
+    Blob<TypeParam> expected(num, channels, crop_size, crop_size);
+    Blob<TypeParam> blob(num, channels, crop_size, crop_size);
+    Blob<TypeParam> item(1, channels, crop_size, crop_size);
+    vector<uint8_t> raw_crops(blob.count());
+    vector<int> crops(num * 3);
+    for (int iter = 0; iter < this->num_iter_; ++iter) {
+      for (int n = 0; n < num; ++n) {
+        Datum datum;
+        FillDatum(iter + n, channels, height, width, true, &datum);
+        DatumView view(datum);
+        item.set_cpu_data(expected.mutable_cpu_data() + expected.offset(n));
+        transformer.Transform(view, &item);
+        raw_transformer.CropRaw(view, item, &raw_crops[blob.offset(n)],
+            &crops[n * 3]);
+      }
+      raw_transformer.TransformRaw_cpu(&raw_crops[0], &crops[0], &blob);
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(expected.cpu_data()[j], blob.cpu_data()[j])
+            << "mean " << mean << " iter " << iter << " j " << j;
+      }
+#ifndef CPU_ONLY
+      Blob<int> crops_blob(num, 3, 1, 1);
+      caffe_copy(crops.size(), &crops[0], crops_blob.mutable_cpu_data());
+      SyncedMemory raw(raw_crops.size());
+      memcpy(raw.mutable_cpu_data(), &raw_crops[0], raw_crops.size());
+      Blob<TypeParam> gpu_blob(blob.shape());
+      raw_transformer.TransformRaw_gpu(
+          static_cast<const uint8_t*>(raw.gpu_data()), crops_blob.gpu_data(),
+          &gpu_blob);
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_NEAR(expected.cpu_data()[j], gpu_blob.cpu_data()[j], 1e-5)
+            << "mean " << mean << " iter " << iter << " j " << j;
+      }
+#endif
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
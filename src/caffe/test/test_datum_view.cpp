@@ -0,0 +1,133 @@
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_view.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DatumViewTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    datum_.set_channels(3);
+    datum_.set_height(4);
+    datum_.set_width(5);
+    datum_.set_label(-7);
+    for (int i = 0; i < 3 * 4 * 5; ++i) {
+      datum_.mutable_data()->push_back(static_cast<char>(i * 13));
+    }
+    datum_.SerializeToString(&record_);
+  }
+
+  Datum datum_;
+  string record_;
+};
+
+TEST_F(DatumViewTest, TestParse) {
+  DatumView view;
+  ASSERT_TRUE(ParseDatumView(record_.data(), record_.size(), &view));
+  EXPECT_EQ(3, view.channels);
+  EXPECT_EQ(4, view.height);
+  EXPECT_EQ(5, view.width);
+  EXPECT_EQ(-7, view.label);
+  EXPECT_FALSE(view.encoded);
+  EXPECT_TRUE(view.float_data == NULL);
+  ASSERT_EQ(datum_.data().size(), view.size);
+  // The view points into the record
+  EXPECT_GE(reinterpret_cast<const char*>(view.data), record_.data());
+  EXPECT_LT(reinterpret_cast<const char*>(view.data),
+            record_.data() + record_.size());
+  EXPECT_EQ(datum_.data(),
+            string(reinterpret_cast<const char*>(view.data), view.size));
+}
+
+TEST_F(DatumViewTest, TestParseEncoded) {
+  datum_.set_encoded(true);
+  datum_.SerializeToString(&record_);
+  DatumView view;
+  ASSERT_TRUE(ParseDatumView(record_.data(), record_.size(), &view));
+  EXPECT_TRUE(view.encoded);
+  EXPECT_EQ(datum_.data().size(), view.size);
+}
+
+TEST_F(DatumViewTest, TestParseUnknownFields) {
+  // fields a later Datum might add, one of every wire type, before the rest
+  string unknown;
+  {
+    google::protobuf::io::StringOutputStream stream(&unknown);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    output.WriteTag((100 << 3) | 0);
+    output.WriteVarint64(1ULL << 40);
+    output.WriteTag((101 << 3) | 1);
+    output.WriteLittleEndian64(7);
+    output.WriteTag((102 << 3) | 2);
+    output.WriteVarint32(3);
+    output.WriteString("abc");
+    output.WriteTag((103 << 3) | 5);
+    output.WriteLittleEndian32(9);
+  }
+  record_ = unknown + record_;
+  DatumView view;
+  ASSERT_TRUE(ParseDatumView(record_.data(), record_.size(), &view));
+  EXPECT_EQ(3, view.channels);
+  EXPECT_EQ(-7, view.label);
+  EXPECT_EQ(datum_.data(),
+            string(reinterpret_cast<const char*>(view.data), view.size));
+}
+
+TEST_F(DatumViewTest, TestParseFloatData) {
+  datum_.clear_data();
+  datum_.add_float_data(1.5);
+  datum_.SerializeToString(&record_);
+  DatumView view;
+  EXPECT_FALSE(ParseDatumView(record_.data(), record_.size(), &view));
+}
+
+TEST_F(DatumViewTest, TestParseTruncated) {
+  DatumView view;
+  EXPECT_FALSE(ParseDatumView(record_.data(), record_.size() - 1, &view));
+}
+
+template <typename Dtype>
+class DatumViewTransformTest : public DatumViewTest {};
+
+TYPED_TEST_CASE(DatumViewTransformTest, TestDtypes);
+
+TYPED_TEST(DatumViewTransformTest, TestTransform) {
+  TransformationParameter transform_param;
+  transform_param.set_crop_size(3);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(0.5);
+  transform_param.add_mean_value(10);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  DatumView view;
+  ASSERT_TRUE(ParseDatumView(this->record_.data(), this->record_.size(),
+                             &view));
+  vector<int> shape = transformer.InferBlobShape(view);
+  EXPECT_EQ(transformer.InferBlobShape(this->datum_), shape);
+  Blob<TypeParam> datum_blob(shape);
+  Blob<TypeParam> view_blob(shape);
+  for (int iter = 0; iter < 10; ++iter) {
+    Caffe::set_random_seed(1701 + iter);
+    transformer.InitRand();
+    transformer.Transform(this->datum_, &datum_blob);
+    Caffe::set_random_seed(1701 + iter);
+    transformer.InitRand();
+    transformer.Transform(view, &view_blob);
+    for (int i = 0; i < datum_blob.count(); ++i) {
+      EXPECT_EQ(datum_blob.cpu_data()[i], view_blob.cpu_data()[i]);
+    }
+  }
+}
+
+}  // namespace caffe
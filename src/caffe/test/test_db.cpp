@@ -1,5 +1,6 @@
 #if defined(USE_LEVELDB) && defined(USE_LMDB) && defined(USE_OPENCV)
 #include <string>
+#include <vector>
 
 #include "boost/scoped_ptr.hpp"
 #include "gtest/gtest.h"
@@ -93,6 +94,30 @@ TYPED_TEST(DBTest, TestSeekToFirst) {
   EXPECT_EQ(datum.width(), 480);
 }
 
+TYPED_TEST(DBTest, TestSeek) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->Seek("fish-bike.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ("fish-bike.jpg", cursor->key());
+  // not a key: the first key after it
+  cursor->Seek("dog.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ("fish-bike.jpg", cursor->key());
+  cursor->Seek("a");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ("cat.jpg", cursor->key());
+  cursor->Seek("zebra.jpg");
+  EXPECT_FALSE(cursor->valid());
+}
+
+TYPED_TEST(DBTest, TestCount) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  EXPECT_EQ(2, db->Count());
+}
+
 TYPED_TEST(DBTest, TestKeyValue) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::READ);
@@ -117,6 +142,36 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestReadBatch) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  vector<string> expected;
+  for (; cursor->valid(); cursor->Next()) {
+    expected.push_back(cursor->value());
+  }
+  ASSERT_EQ(2, expected.size());
+  cursor->SeekToFirst();
+  vector<db::RecordView> values;
+  EXPECT_EQ(1, cursor->ReadBatch(1, &values));
+  ASSERT_EQ(1, values.size());
+  EXPECT_EQ(expected[0], string(values[0].data, values[0].size));
+  EXPECT_TRUE(cursor->valid());
+  // stops at the end of the database
+  EXPECT_EQ(1, cursor->ReadBatch(5, &values));
+  ASSERT_EQ(1, values.size());
+  EXPECT_EQ(expected[1], string(values[0].data, values[0].size));
+  EXPECT_FALSE(cursor->valid());
+  EXPECT_EQ(0, cursor->ReadBatch(5, &values));
+  EXPECT_TRUE(values.empty());
+  cursor->SeekToFirst();
+  EXPECT_EQ(2, cursor->ReadBatch(2, &values));
+  Datum datum;
+  datum.ParseFromArray(values[1].data, values[1].size);
+  EXPECT_EQ(datum.height(), 323);
+  EXPECT_EQ(datum.width(), 481);
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
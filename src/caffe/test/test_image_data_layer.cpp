@@ -215,5 +215,44 @@ TYPED_TEST(ImageDataLayerTest, TestSpace) {
   EXPECT_EQ(this->blob_top_label_->cpu_data()[0], 1);
 }
 
+TYPED_TEST(ImageDataLayerTest, TestDecodeThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shuffle(true);
+  image_data_param->set_decode_threads(3);
+  TransformationParameter* transform_param = param.mutable_transform_param();
+  transform_param->set_crop_size(64);
+  transform_param->set_mirror(true);
+  // Two layers from the same seed give the same batches, whatever the
+  // threads decoding them.
+  vector<vector<Dtype> > data(2);
+  vector<vector<Dtype> > labels(2);
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->blob_top_data_->num(), 5);
+    EXPECT_EQ(this->blob_top_data_->height(), 64);
+    EXPECT_EQ(this->blob_top_data_->width(), 64);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      data[run].insert(data[run].end(), this->blob_top_data_->cpu_data(),
+          this->blob_top_data_->cpu_data() + this->blob_top_data_->count());
+      labels[run].insert(labels[run].end(), this->blob_top_label_->cpu_data(),
+          this->blob_top_label_->cpu_data() + 5);
+    }
+  }
+  ASSERT_EQ(data[0].size(), data[1].size());
+  for (int i = 0; i < data[0].size(); ++i) {
+    ASSERT_EQ(data[0][i], data[1][i]) << "at " << i;
+  }
+  for (int i = 0; i < labels[0].size(); ++i) {
+    EXPECT_EQ(labels[0][i], labels[1][i]);
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -0,0 +1,84 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_list.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageListTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempFilename(&text_filename_);
+    std::ofstream outfile(text_filename_.c_str(), std::ofstream::out);
+    outfile << "images/cat.jpg 3\n";
+    outfile << "images/cat gray.jpg 12\r\n";
+    outfile << "\n";
+    outfile << "a\t-1  \n";
+    outfile << "fish-bike.jpg 0\n";
+    outfile.close();
+    MakeTempFilename(&binary_filename_);
+  }
+
+  void CheckList(const ImageList& list) {
+    ASSERT_EQ(4, list.size());
+    EXPECT_EQ("images/cat.jpg", list.name(0));
+    EXPECT_EQ(3, list.label(0));
+    EXPECT_EQ("images/cat gray.jpg", list.name(1));
+    EXPECT_EQ(12, list.label(1));
+    EXPECT_EQ("a", list.name(2));
+    EXPECT_EQ(-1, list.label(2));
+    EXPECT_EQ("fish-bike.jpg", list.name(3));
+    EXPECT_EQ(0, list.label(3));
+  }
+
+  string text_filename_;
+  string binary_filename_;
+};
+
+TEST_F(ImageListTest, TestText) {
+  ImageList list;
+  list.Open(text_filename_);
+  EXPECT_FALSE(list.mapped());
+  CheckList(list);
+}
+
+TEST_F(ImageListTest, TestBinary) {
+  ImageList text_list;
+  text_list.Open(text_filename_);
+  WriteImageList(text_list, binary_filename_);
+  ImageList list;
+  list.Open(binary_filename_);
+  EXPECT_TRUE(list.mapped());
+  CheckList(list);
+  // a mapped list writes back the same file
+  string copy_filename;
+  MakeTempFilename(&copy_filename);
+  WriteImageList(list, copy_filename);
+  ImageList copy;
+  copy.Open(copy_filename);
+  CheckList(copy);
+  list.Close();
+  EXPECT_TRUE(list.empty());
+  EXPECT_FALSE(list.mapped());
+}
+
+TEST_F(ImageListTest, TestEmpty) {
+  std::ofstream outfile(text_filename_.c_str(), std::ofstream::out);
+  outfile.close();
+  ImageList text_list;
+  text_list.Open(text_filename_);
+  EXPECT_TRUE(text_list.empty());
+  WriteImageList(text_list, binary_filename_);
+  ImageList list;
+  list.Open(binary_filename_);
+  EXPECT_TRUE(list.mapped());
+  EXPECT_TRUE(list.empty());
+}
+
+}  // namespace caffe
@@ -0,0 +1,89 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/infer_superclasses_layer.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class InferSuperclassesLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  InferSuperclassesLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 6, 3, 4)),
+        blob_top_(new Blob<Dtype>()) {
+    // coarse 0 = {0, 2}, coarse 1 = {1, 4, 5}, fine 3 is not mapped
+    MakeTempFilename(&mapping_file_);
+    std::ofstream outfile(mapping_file_.c_str());
+    outfile << "0,2\n1, 4, 5\n";
+    outfile.close();
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~InferSuperclassesLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  string mapping_file_;
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(InferSuperclassesLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(InferSuperclassesLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_map_labels_param()->set_mapping_file(
+      this->mapping_file_);
+  InferSuperclassesLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 2);
+  EXPECT_EQ(this->blob_top_->channels(), 2);
+  EXPECT_EQ(this->blob_top_->height(), 3);
+  EXPECT_EQ(this->blob_top_->width(), 4);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Blob<Dtype>* fine = this->blob_bottom_;
+  for (int n = 0; n < 2; ++n) {
+    for (int h = 0; h < 3; ++h) {
+      for (int w = 0; w < 4; ++w) {
+        EXPECT_NEAR(this->blob_top_->data_at(n, 0, h, w),
+            fine->data_at(n, 0, h, w) + fine->data_at(n, 2, h, w), 1e-5);
+        EXPECT_NEAR(this->blob_top_->data_at(n, 1, h, w),
+            fine->data_at(n, 1, h, w) + fine->data_at(n, 4, h, w) +
+            fine->data_at(n, 5, h, w), 1e-5);
+      }
+    }
+  }
+}
+
+TYPED_TEST(InferSuperclassesLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_map_labels_param()->set_mapping_file(
+      this->mapping_file_);
+  InferSuperclassesLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -0,0 +1,110 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/map_labels_layer.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class MapLabelsLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  MapLabelsLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 1, 3, 4)),
+        blob_top_(new Blob<Dtype>()) {
+    // coarse 0 = {0, 2}, coarse 1 = {1, 4, 5}, fine 3 is not mapped
+    MakeTempFilename(&mapping_file_);
+    std::ofstream outfile(mapping_file_.c_str());
+    outfile << "0,2\n1, 4, 5\n";
+    outfile.close();
+    const Dtype labels[] = {0, 1, 2, 3, 4, 5, 6, 100, -1, 255, 5, 2,
+                            1, 1, 0, 0, 4, 4, 3, 3, 2, 2, 5, 5};
+    for (int i = 0; i < blob_bottom_->count(); ++i) {
+      blob_bottom_->mutable_cpu_data()[i] = labels[i];
+    }
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~MapLabelsLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  string mapping_file_;
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MapLabelsLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(MapLabelsLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_map_labels_param()->set_mapping_file(
+      this->mapping_file_);
+  layer_param.mutable_map_labels_param()->set_ignore_label(-1);
+  MapLabelsLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype expected[] = {0, 1, 0, -1, 1, 1, -1, -1, -1, -1, 1, 0,
+                            1, 1, 0, 0, 1, 1, -1, -1, 0, 0, 1, 1};
+  ASSERT_EQ(this->blob_top_->count(), this->blob_bottom_->count());
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(expected[i], this->blob_top_->cpu_data()[i]) << "at " << i;
+  }
+}
+
+TYPED_TEST(MapLabelsLayerTest, TestForwardDefaultIgnore) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_map_labels_param()->set_mapping_file(
+      this->mapping_file_);
+  MapLabelsLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // unmapped fine label, past the table, negative and ignored input
+  EXPECT_EQ(255, this->blob_top_->cpu_data()[3]);
+  EXPECT_EQ(255, this->blob_top_->cpu_data()[7]);
+  EXPECT_EQ(255, this->blob_top_->cpu_data()[8]);
+  EXPECT_EQ(255, this->blob_top_->cpu_data()[9]);
+}
+
+TYPED_TEST(MapLabelsLayerTest, TestForwardManyCoarseLabels) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 300 coarse labels of one fine label each, fine 2 c mapped to coarse c,
+  // so the default ignore_label 255 is a coarse label
+  string mapping_file;
+  MakeTempFilename(&mapping_file);
+  std::ofstream outfile(mapping_file.c_str());
+  for (int c = 0; c < 300; ++c) {
+    outfile << 2 * c << "\n";
+  }
+  outfile.close();
+  LayerParameter layer_param;
+  layer_param.mutable_map_labels_param()->set_mapping_file(mapping_file);
+  MapLabelsLayer<Dtype> layer(layer_param);
+  const Dtype labels[] = {0, 510, 598, 1, 600, -1};
+  const Dtype expected[] = {0, 255, 299, -1, -1, -1};
+  this->blob_bottom_->Reshape(1, 1, 1, 6);
+  for (int i = 0; i < 6; ++i) {
+    this->blob_bottom_->mutable_cpu_data()[i] = labels[i];
+  }
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected[i], this->blob_top_->cpu_data()[i]) << "at " << i;
+  }
+}
+
+}  // namespace caffe
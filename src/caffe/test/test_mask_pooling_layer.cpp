@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/mask_pooling_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class MaskPoolingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  MaskPoolingLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_bottom_mask_(new Blob<Dtype>(2, 1, 4, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    filler.Fill(this->blob_bottom_mask_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_mask_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~MaskPoolingLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_mask_;
+    delete blob_top_;
+  }
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_mask_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MaskPoolingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(MaskPoolingLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MaskPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 2);
+  EXPECT_EQ(this->blob_top_->channels(), 3);
+  EXPECT_EQ(this->blob_top_->height(), 4);
+  EXPECT_EQ(this->blob_top_->width(), 5);
+}
+
+TYPED_TEST(MaskPoolingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MaskPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int n = 0; n < this->blob_top_->num(); ++n) {
+    for (int c = 0; c < this->blob_top_->channels(); ++c) {
+      for (int h = 0; h < this->blob_top_->height(); ++h) {
+        for (int w = 0; w < this->blob_top_->width(); ++w) {
+          EXPECT_NEAR(this->blob_top_->data_at(n, c, h, w),
+              this->blob_bottom_data_->data_at(n, c, h, w) *
+              this->blob_bottom_mask_->data_at(n, 0, h, w), 1e-6);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(MaskPoolingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MaskPoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+#ifndef CPU_ONLY
+
+// Runs the CPU and CUDA paths on an MNC-sized input, checks that they agree
+// and logs the time each one takes for a forward/backward pass.
+template <typename Dtype>
+class MaskPoolingLayerBenchmarkTest : public GPUDeviceTest<Dtype> {
+ protected:
+  MaskPoolingLayerBenchmarkTest()
+      : blob_bottom_data_(new Blob<Dtype>(64, 256, 21, 21)),
+        blob_bottom_mask_(new Blob<Dtype>(64, 1, 21, 21)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    filler.Fill(this->blob_bottom_mask_);
+    filler.Fill(this->blob_top_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_mask_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~MaskPoolingLayerBenchmarkTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_mask_;
+    delete blob_top_;
+  }
+
+  // Forward and backward once in the current mode, returning the time taken
+  float TimePass(MaskPoolingLayer<Dtype>* layer, Timer* timer) {
+    vector<bool> propagate_down(2, true);
+    timer->Start();
+    layer->Forward(blob_bottom_vec_, blob_top_vec_);
+    caffe_copy(blob_top_->count(), blob_top_->cpu_data(),
+        blob_top_->mutable_cpu_diff());
+    layer->Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+    timer->Stop();
+    return timer->MilliSeconds();
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_mask_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MaskPoolingLayerBenchmarkTest, TestDtypes);
+
+TYPED_TEST(MaskPoolingLayerBenchmarkTest, TestCPUMatchesGPU) {
+  LayerParameter layer_param;
+  MaskPoolingLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  Caffe::set_mode(Caffe::CPU);
+  CPUTimer cpu_timer;
+  const float cpu_ms = this->TimePass(&layer, &cpu_timer);
+  Blob<TypeParam> cpu_top, cpu_data_diff, cpu_mask_diff;
+  cpu_top.CopyFrom(*this->blob_top_, false, true);
+  cpu_data_diff.CopyFrom(*this->blob_bottom_data_, true, true);
+  cpu_mask_diff.CopyFrom(*this->blob_bottom_mask_, true, true);
+
+  Caffe::set_mode(Caffe::GPU);
+  Timer gpu_timer;
+  const float gpu_ms = this->TimePass(&layer, &gpu_timer);
+  LOG(INFO) << "MaskPooling forward/backward " << this->blob_bottom_data_->
+      shape_string() << ": CPU " << cpu_ms << " ms, GPU " << gpu_ms << " ms";
+
+  const TypeParam kErrorMargin = 1e-4;
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(cpu_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+        kErrorMargin);
+  }
+  for (int i = 0; i < this->blob_bottom_data_->count(); ++i) {
+    EXPECT_NEAR(cpu_data_diff.cpu_diff()[i],
+        this->blob_bottom_data_->cpu_diff()[i], kErrorMargin);
+  }
+  // the mask gradient sums over all channels, so compare it relatively
+  for (int i = 0; i < this->blob_bottom_mask_->count(); ++i) {
+    const TypeParam expected = cpu_mask_diff.cpu_diff()[i];
+    EXPECT_NEAR(expected, this->blob_bottom_mask_->cpu_diff()[i],
+        kErrorMargin * std::max(TypeParam(1), std::fabs(expected)));
+  }
+}
+
+#endif  // !CPU_ONLY
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,6 +13,7 @@
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/openmp.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -629,6 +632,118 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitSharedActivationsNet(const bool share_activations,
+      const Phase phase = caffe::TEST) {
+    string proto =
+        "name: 'SharedActivationsNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 10 dim: 10 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv3' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv2' "
+        "  bottom: 'conv3' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'flat' "
+        "  type: 'Flatten' "
+        "  bottom: 'sum' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    if (share_activations) {
+      proto += "share_activations: true ";
+    }
+    proto += phase == caffe::TEST ? "state { phase: TEST } " :
+        "state { phase: TRAIN } ";
+    Caffe::set_random_seed(this->seed_);
+    InitNetFromProtoString(proto);
+  }
+
+  // The number of distinct memories holding the data of the net's blobs
+  int NumBlobMemories() {
+    set<SyncedMemory*> memories;
+    for (int i = 0; i < net_->blobs().size(); ++i) {
+      memories.insert(net_->blobs()[i]->data().get());
+    }
+    return memories.size();
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -2446,6 +2561,92 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestSharedActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input1(2, 3, 10, 10);
+  Blob<Dtype> input2(3, 3, 10, 10);
+  filler.Fill(&input1);
+  filler.Fill(&input2);
+  this->InitSharedActivationsNet(false);
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  const int num_memories = this->NumBlobMemories();
+  this->InitSharedActivationsNet(true);
+  EXPECT_LT(this->NumBlobMemories(), num_memories);
+  // Blobs live at the same time do not share
+  Net<Dtype>& net = *this->net_;
+  const string split_name = "conv1_relu1_0_split_0";
+  ASSERT_TRUE(net.has_blob(split_name));
+  EXPECT_EQ(net.blob_by_name("conv1")->data(),
+            net.blob_by_name(split_name)->data());
+  EXPECT_NE(net.blob_by_name("conv1")->data(),
+            net.blob_by_name("conv2")->data());
+  EXPECT_NE(net.blob_by_name("conv1")->data(),
+            net.blob_by_name("conv3")->data());
+  EXPECT_NE(net.blob_by_name("conv2")->data(),
+            net.blob_by_name("conv3")->data());
+  EXPECT_NE(net.blob_by_name("conv2")->data(),
+            net.blob_by_name("sum")->data());
+  EXPECT_EQ(net.blob_by_name("sum")->data(),
+            net.blob_by_name("flat")->data());
+  EXPECT_NE(net.blob_by_name("data")->data(),
+            net.blob_by_name("prob")->data());
+  // The outputs match the net without sharing, also after reshaping
+  for (int iter = 0; iter < 3; ++iter) {
+    const Blob<Dtype>& input = iter == 1 ? input2 : input1;
+    Net<Dtype>* nets[2] = {reference_net.get(), &net};
+    for (int i = 0; i < 2; ++i) {
+      Blob<Dtype>* input_blob = nets[i]->input_blobs()[0];
+      input_blob->ReshapeLike(input);
+      input_blob->CopyFrom(input);
+      nets[i]->Reshape();
+      nets[i]->Forward();
+    }
+    EXPECT_LT(this->NumBlobMemories(), num_memories);
+    const Blob<Dtype>* expected = reference_net->output_blobs()[0];
+    const Blob<Dtype>* output = net.output_blobs()[0];
+    ASSERT_EQ(expected->shape(), output->shape());
+    for (int i = 0; i < output->count(); ++i) {
+      EXPECT_EQ(expected->cpu_data()[i], output->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestSharedActivationsTrain) {
+  this->InitSharedActivationsNet(false, caffe::TRAIN);
+  const int num_memories = this->NumBlobMemories();
+  this->InitSharedActivationsNet(true, caffe::TRAIN);
+  EXPECT_EQ(num_memories, this->NumBlobMemories());
+}
+
+TYPED_TEST(NetTest, TestSharedWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitSharedActivationsNet(false);
+  // conv2 has the largest column buffer: 4 x 3 x 3 kernel by 10 x 10 output,
+  // for each CPU worker on the batch of 2
+  const int num_workers = Caffe::mode() == Caffe::CPU ?
+      std::min(2, caffe_omp_max_threads()) : 1;
+  ASSERT_TRUE(this->net_->workspace() != NULL);
+  EXPECT_EQ(num_workers * 36 * 100 * sizeof(Dtype),
+            this->net_->workspace()->size());
+  size_t workspace_size = 0;
+  for (int i = 0; i < this->net_->layers().size(); ++i) {
+    workspace_size = std::max(workspace_size,
+        this->net_->layers()[i]->WorkspaceSize());
+  }
+  EXPECT_EQ(workspace_size, this->net_->workspace()->size());
+  // Reshaping plans the workspace again: 3 x 3 x 3 kernel by 49 x 49 output,
+  // then by 9 x 9
+  this->InitReshapableNet();
+  EXPECT_EQ(27 * 49 * 49 * sizeof(Dtype), this->net_->workspace()->size());
+  this->net_->input_blobs()[0]->Reshape(1, 3, 20, 20);
+  this->net_->Reshape();
+  EXPECT_EQ(27 * 9 * 9 * sizeof(Dtype), this->net_->workspace()->size());
+  this->net_->Forward();
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
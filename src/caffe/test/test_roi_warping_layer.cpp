@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/roi_warping_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ROIWarpingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  ROIWarpingLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(2, 3, 6, 8)),
+        blob_bottom_rois_(new Blob<Dtype>(4, 5, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(10);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    // [batch_index x1 y1 x2 y2], the last one partly off the feature map
+    const Dtype rois[4][5] = {
+      {0, 0, 0, 7, 5},
+      {1, 1, 2, 5, 4},
+      {0, 2, 1, 3, 5},
+      {1, 4, 3, 12, 9},
+    };
+    Dtype* roi_data = blob_bottom_rois_->mutable_cpu_data();
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 5; ++j) {
+        roi_data[i * 5 + j] = rois[i][j];
+      }
+    }
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~ROIWarpingLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_rois_;
+    delete blob_top_;
+  }
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ROIWarpingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ROIWarpingLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIWarpingParameter* roi_warping_param =
+      layer_param.mutable_roi_warping_param();
+  roi_warping_param->set_pooled_h(3);
+  roi_warping_param->set_pooled_w(4);
+  ROIWarpingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 4);
+  EXPECT_EQ(this->blob_top_->channels(), 3);
+  EXPECT_EQ(this->blob_top_->height(), 3);
+  EXPECT_EQ(this->blob_top_->width(), 4);
+}
+
+TYPED_TEST(ROIWarpingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Bilinear sampling reproduces a plane exactly, so fill each channel with
+  // a linear ramp and compare against the analytic sampling positions.
+  Blob<Dtype>* data = this->blob_bottom_data_;
+  for (int n = 0; n < data->num(); ++n) {
+    for (int c = 0; c < data->channels(); ++c) {
+      for (int h = 0; h < data->height(); ++h) {
+        for (int w = 0; w < data->width(); ++w) {
+          data->mutable_cpu_data()[data->offset(n, c, h, w)] =
+              100 * n + 30 * c + 10 * h + w;
+        }
+      }
+    }
+  }
+  LayerParameter layer_param;
+  ROIWarpingParameter* roi_warping_param =
+      layer_param.mutable_roi_warping_param();
+  roi_warping_param->set_pooled_h(3);
+  roi_warping_param->set_pooled_w(4);
+  ROIWarpingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* rois = this->blob_bottom_rois_->cpu_data();
+  for (int r = 0; r < this->blob_top_->num(); ++r) {
+    const Dtype* roi = rois + r * 5;
+    const Dtype bin_h = (roi[4] - roi[2]) / 3;
+    const Dtype bin_w = (roi[3] - roi[1]) / 4;
+    for (int c = 0; c < 3; ++c) {
+      for (int ph = 0; ph < 3; ++ph) {
+        for (int pw = 0; pw < 4; ++pw) {
+          const Dtype ih = roi[2] + ph * bin_h;
+          const Dtype iw = roi[1] + pw * bin_w;
+          Dtype expected = 0;
+          if (ih <= data->height() - 0.5 && iw <= data->width() - 0.5) {
+            expected = 100 * roi[0] + 30 * c +
+                10 * std::min(ih, Dtype(data->height() - 1)) +
+                std::min(iw, Dtype(data->width() - 1));
+          }
+          EXPECT_NEAR(this->blob_top_->data_at(r, c, ph, pw), expected, 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ROIWarpingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIWarpingParameter* roi_warping_param =
+      layer_param.mutable_roi_warping_param();
+  roi_warping_param->set_pooled_h(3);
+  roi_warping_param->set_pooled_w(4);
+  ROIWarpingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  // ROI coordinates are rounded, so only the features have a numeric gradient
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(ROIWarpingLayerTest, TestGradientROI) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Rounding makes the numeric gradient of the ROI coordinates zero, so
+  // check the analytic one on a plane instead: with v = 10 h + w, every
+  // sample at (1 - r) of the way from the ROI start contributes 10 (1 - r)
+  // to y1 and 10 r to y2, and likewise 1 - r and r to x1 and x2. As in the
+  // GPU layer, r is measured against the inclusive ROI size, end - start + 1.
+  Blob<Dtype>* data = this->blob_bottom_data_;
+  for (int n = 0; n < data->num(); ++n) {
+    for (int c = 0; c < data->channels(); ++c) {
+      for (int h = 0; h < data->height(); ++h) {
+        for (int w = 0; w < data->width(); ++w) {
+          data->mutable_cpu_data()[data->offset(n, c, h, w)] = 10 * h + w;
+        }
+      }
+    }
+  }
+  // ROIs whose samples all have a right and lower neighbour on the map
+  const Dtype rois[3][5] = {
+    {0, 0, 0, 6, 4},
+    {1, 1, 2, 5, 4},
+    {0, 2, 1, 3, 3},
+  };
+  this->blob_bottom_rois_->Reshape(3, 5, 1, 1);
+  Dtype* roi_data = this->blob_bottom_rois_->mutable_cpu_data();
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 5; ++j) {
+      roi_data[i * 5 + j] = rois[i][j];
+    }
+  }
+  LayerParameter layer_param;
+  ROIWarpingParameter* roi_warping_param =
+      layer_param.mutable_roi_warping_param();
+  roi_warping_param->set_pooled_h(3);
+  roi_warping_param->set_pooled_w(4);
+  ROIWarpingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_set(this->blob_top_->count(), Dtype(1),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(2, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const int channels = data->channels();
+  for (int r = 0; r < 3; ++r) {
+    const Dtype* roi = rois[r];
+    const Dtype width = roi[3] - roi[1];
+    const Dtype height = roi[4] - roi[2];
+    Dtype expected[5] = {0, 0, 0, 0, 0};
+    for (int ph = 0; ph < 3; ++ph) {
+      for (int pw = 0; pw < 4; ++pw) {
+        const Dtype ratio_h = ph * height / 3 / (height + 1);
+        const Dtype ratio_w = pw * width / 4 / (width + 1);
+        expected[1] += channels * (1 - ratio_w);
+        expected[2] += channels * 10 * (1 - ratio_h);
+        expected[3] += channels * ratio_w;
+        expected[4] += channels * 10 * ratio_h;
+      }
+    }
+    for (int k = 0; k < 5; ++k) {
+      EXPECT_NEAR(this->blob_bottom_rois_->cpu_diff()[r * 5 + k],
+          expected[k], 1e-4 * std::max(Dtype(1), std::fabs(expected[k])));
+    }
+  }
+}
+
+}  // namespace caffe
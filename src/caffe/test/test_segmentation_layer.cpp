@@ -0,0 +1,239 @@
+#ifdef USE_OPENCV
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/segmentation_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// The backends read the image planes as 32-bit floats, so only float is
+// tested.
+class SegmentationLayerTest : public CPUDeviceTest<float> {
+ protected:
+  SegmentationLayerTest()
+      : blob_bottom_(new Blob<float>(2, 3, 60, 80)),
+        blob_top_boxes_(new Blob<float>()),
+        blob_top_seg_(new Blob<float>()) {
+    // three flat regions per image, split differently in each image
+    for (int n = 0; n < 2; ++n) {
+      for (int c = 0; c < 3; ++c) {
+        for (int h = 0; h < 60; ++h) {
+          for (int w = 0; w < 80; ++w) {
+            float value = 30 + 20 * c;
+            if (w >= 30 + 20 * n) {
+              value = h < 25 ? 220 - 30 * c : 120;
+            }
+            blob_bottom_->mutable_cpu_data()[
+                blob_bottom_->offset(n, c, h, w)] = value;
+          }
+        }
+      }
+    }
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_boxes_);
+    blob_top_vec_.push_back(blob_top_seg_);
+  }
+  virtual ~SegmentationLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_boxes_;
+    delete blob_top_seg_;
+  }
+
+  // Checks that every box lies in its image and that the segment map only
+  // refers to existing boxes of the same image.
+  void CheckSegments() {
+    const int num = blob_bottom_->num();
+    const int height = blob_bottom_->height();
+    const int width = blob_bottom_->width();
+    const int num_boxes = blob_top_boxes_->num();
+    EXPECT_GT(num_boxes, 0);
+    for (int i = 0; i < num_boxes; ++i) {
+      const float* box = blob_top_boxes_->cpu_data() + i * 5;
+      EXPECT_GE(box[0], 0);
+      EXPECT_LT(box[0], num);
+      EXPECT_GE(box[1], 0);
+      EXPECT_GE(box[2], 0);
+      EXPECT_LE(box[1], box[3]);
+      EXPECT_LE(box[2], box[4]);
+      EXPECT_LT(box[3], width);
+      EXPECT_LT(box[4], height);
+    }
+    for (int n = 0; n < num; ++n) {
+      for (int j = 0; j < height * width; ++j) {
+        const int id = static_cast<int>(blob_top_seg_->cpu_data()[
+            blob_top_seg_->offset(n) + j]);
+        ASSERT_GE(id, 0);
+        ASSERT_LT(id, num_boxes);
+        EXPECT_EQ(n, blob_top_boxes_->cpu_data()[id * 5]);
+      }
+    }
+  }
+
+  // Runs a forward pass of the given method and returns its time in ms
+  float TimeForward(const int method) {
+    LayerParameter layer_param;
+    layer_param.mutable_seg_param()->set_method(method);
+    SegmentationLayer<float> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    CPUTimer timer;
+    timer.Start();
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    timer.Stop();
+    return timer.MilliSeconds();
+  }
+
+  Blob<float>* const blob_bottom_;
+  Blob<float>* const blob_top_boxes_;
+  Blob<float>* const blob_top_seg_;
+  vector<Blob<float>*> blob_bottom_vec_;
+  vector<Blob<float>*> blob_top_vec_;
+};
+
+TEST_F(SegmentationLayerTest, TestSetUp) {
+  LayerParameter layer_param;
+  SegmentationLayer<float> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_boxes_->channels(), 5);
+  EXPECT_EQ(this->blob_top_seg_->num(), 2);
+  EXPECT_EQ(this->blob_top_seg_->channels(), 1);
+  EXPECT_EQ(this->blob_top_seg_->height(), 60);
+  EXPECT_EQ(this->blob_top_seg_->width(), 80);
+}
+
+TEST_F(SegmentationLayerTest, TestForwardFH) {
+  this->TimeForward(0);
+  this->CheckSegments();
+}
+
+TEST_F(SegmentationLayerTest, TestForwardSLIC) {
+  this->TimeForward(1);
+  this->CheckSegments();
+}
+
+TEST_F(SegmentationLayerTest, TestForwardFastSLIC) {
+  this->TimeForward(2);
+  this->CheckSegments();
+  // one superpixel per 10 x 10 grid cell at most
+  EXPECT_LE(this->blob_top_boxes_->num(), 2 * 6 * 8);
+}
+
+TEST_F(SegmentationLayerTest, TestForwardLabels) {
+  // label each region differently and check every segment gets the most
+  // frequent label of its pixels
+  Blob<float> label(2, 1, 60, 80);
+  for (int n = 0; n < 2; ++n) {
+    for (int h = 0; h < 60; ++h) {
+      for (int w = 0; w < 80; ++w) {
+        label.mutable_cpu_data()[label.offset(n, 0, h, w)] =
+            w < 30 + 20 * n ? 1 : (h < 25 ? 7 : 3);
+      }
+    }
+  }
+  Blob<float> top_labels;
+  this->blob_bottom_vec_.push_back(&label);
+  this->blob_top_vec_.insert(this->blob_top_vec_.begin() + 1, &top_labels);
+  LayerParameter layer_param;
+  SegmentationLayer<float> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num_boxes = this->blob_top_boxes_->num();
+  ASSERT_EQ(num_boxes, top_labels.num());
+  vector<vector<int> > hist(num_boxes, vector<int>(8, 0));
+  for (int i = 0; i < label.count(); ++i) {
+    const int id = static_cast<int>(this->blob_top_seg_->cpu_data()[i]);
+    hist[id][static_cast<int>(label.cpu_data()[i])]++;
+  }
+  for (int id = 0; id < num_boxes; ++id) {
+    const int mode = std::max_element(hist[id].begin(), hist[id].end()) -
+        hist[id].begin();
+    EXPECT_EQ(mode, top_labels.cpu_data()[id]);
+  }
+}
+
+TEST_F(SegmentationLayerTest, TestMaxSegments) {
+  LayerParameter layer_param;
+  layer_param.mutable_seg_param()->set_method(2);
+  layer_param.mutable_seg_param()->set_max_segments(5);
+  SegmentationLayer<float> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_boxes_->num(), 2 * 5);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(0, this->blob_top_boxes_->cpu_data()[i * 5]);
+    EXPECT_EQ(1, this->blob_top_boxes_->cpu_data()[(5 + i) * 5]);
+  }
+}
+
+TEST_F(SegmentationLayerTest, TestTopsSizedToSegments) {
+  // one box per segment found, whether or not a cap above that is set
+  LayerParameter layer_param;
+  SegmentationLayer<float> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckSegments();
+  const float* seg = this->blob_top_seg_->cpu_data();
+  const std::set<int> ids(seg, seg + this->blob_top_seg_->count());
+  const int num_boxes = this->blob_top_boxes_->num();
+  EXPECT_EQ(ids.size(), num_boxes);
+  vector<int> areas(num_boxes, 0);
+  for (int i = 0; i < this->blob_top_seg_->count(); ++i) {
+    areas[static_cast<int>(seg[i])]++;
+  }
+  vector<int> largest(2, 0);
+  for (int id = 0; id < num_boxes; ++id) {
+    const int n = this->blob_top_boxes_->cpu_data()[id * 5];
+    largest[n] = std::max(largest[n], areas[id]);
+  }
+  layer_param.mutable_seg_param()->set_max_segments(100);
+  SegmentationLayer<float> loose_layer(layer_param);
+  loose_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  loose_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(num_boxes, this->blob_top_boxes_->num());
+  // a cap below the count keeps the largest segment of each image and marks
+  // the pixels of the others -1
+  layer_param.mutable_seg_param()->set_max_segments(1);
+  SegmentationLayer<float> capped_layer(layer_param);
+  capped_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  capped_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(2, this->blob_top_boxes_->num());
+  for (int n = 0; n < 2; ++n) {
+    EXPECT_EQ(n, this->blob_top_boxes_->cpu_data()[n * 5]);
+    const float* image_seg = this->blob_top_seg_->cpu_data() +
+        this->blob_top_seg_->offset(n);
+    int kept = 0;
+    for (int j = 0; j < 60 * 80; ++j) {
+      if (image_seg[j] >= 0) {
+        EXPECT_EQ(n, image_seg[j]);
+        ++kept;
+      } else {
+        EXPECT_EQ(-1, image_seg[j]);
+      }
+    }
+    EXPECT_EQ(largest[n], kept);
+  }
+}
+
+TEST_F(SegmentationLayerTest, TestSLICBenchmark) {
+  // larger input so that the timings mean something
+  this->blob_bottom_->Reshape(4, 3, 240, 320);
+  float* data = this->blob_bottom_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    data[i] = (i * 31) % 256;
+  }
+  const float slic_ms = this->TimeForward(1);
+  const float fast_slic_ms = this->TimeForward(2);
+  this->CheckSegments();
+  LOG(INFO) << "SLIC on " << this->blob_bottom_->shape_string() << ": "
+      << slic_ms << " ms, fast SLIC: " << fast_slic_ms << " ms";
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -0,0 +1,146 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/smooth_L1_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SmoothL1LossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SmoothL1LossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(10, 5, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(10, 5, 1, 1)),
+        blob_bottom_inside_weights_(new Blob<Dtype>(10, 5, 1, 1)),
+        blob_bottom_outside_weights_(new Blob<Dtype>(10, 5, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(2);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    filler.Fill(this->blob_bottom_label_);
+    FillerParameter weight_param;
+    weight_param.set_min(0.5);
+    weight_param.set_max(1.5);
+    UniformFiller<Dtype> weight_filler(weight_param);
+    weight_filler.Fill(this->blob_bottom_inside_weights_);
+    weight_filler.Fill(this->blob_bottom_outside_weights_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~SmoothL1LossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_bottom_inside_weights_;
+    delete blob_bottom_outside_weights_;
+    delete blob_top_loss_;
+  }
+
+  void AddWeights() {
+    blob_bottom_vec_.push_back(blob_bottom_inside_weights_);
+    blob_bottom_vec_.push_back(blob_bottom_outside_weights_);
+  }
+
+  // Reference loss computed elementwise from the definition
+  Dtype ReferenceLoss(const Dtype sigma, const bool with_weights) {
+    const Dtype sigma2 = sigma * sigma;
+    Dtype loss = 0;
+    for (int i = 0; i < blob_bottom_data_->count(); ++i) {
+      Dtype x = blob_bottom_data_->cpu_data()[i] -
+          blob_bottom_label_->cpu_data()[i];
+      if (with_weights) {
+        x *= blob_bottom_inside_weights_->cpu_data()[i];
+      }
+      Dtype error = std::fabs(x) < 1 / sigma2 ?
+          0.5 * x * x * sigma2 : std::fabs(x) - 0.5 / sigma2;
+      if (with_weights) {
+        error *= blob_bottom_outside_weights_->cpu_data()[i];
+      }
+      loss += error;
+    }
+    return loss / blob_bottom_data_->num();
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_inside_weights_;
+  Blob<Dtype>* const blob_bottom_outside_weights_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SmoothL1LossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SmoothL1LossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_smooth_l1_loss_param()->set_sigma(0.8);
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // the layer has no default loss weight, so read the top rather than the
+  // weighted loss returned by Forward
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss = this->blob_top_loss_->cpu_data()[0];
+  const Dtype expected = this->ReferenceLoss(0.8, false);
+  EXPECT_NEAR(loss, expected, 1e-5 * std::fabs(expected));
+}
+
+TYPED_TEST(SmoothL1LossLayerTest, TestForwardWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->AddWeights();
+  LayerParameter layer_param;
+  layer_param.mutable_smooth_l1_loss_param()->set_sigma(0.8);
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // the layer has no default loss weight, so read the top rather than the
+  // weighted loss returned by Forward
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss = this->blob_top_loss_->cpu_data()[0];
+  const Dtype expected = this->ReferenceLoss(0.8, true);
+  EXPECT_NEAR(loss, expected, 1e-5 * std::fabs(expected));
+}
+
+TYPED_TEST(SmoothL1LossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  const Dtype kLossWeight = 3.7;
+  layer_param.add_loss_weight(kLossWeight);
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 1);
+}
+
+TYPED_TEST(SmoothL1LossLayerTest, TestGradientWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->AddWeights();
+  LayerParameter layer_param;
+  const Dtype kLossWeight = 3.7;
+  layer_param.add_loss_weight(kLossWeight);
+  layer_param.mutable_smooth_l1_loss_param()->set_sigma(2);
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 1);
+}
+
+}  // namespace caffe
@@ -0,0 +1,109 @@
+#include <google/protobuf/io/coded_stream.h>
+
+#include <climits>
+
+#include "caffe/util/datum_view.hpp"
+
+namespace caffe {
+
+using google::protobuf::io::CodedInputStream;
+
+// A tag is the field number shifted left by 3 over the wire type, as laid
+// out in the protocol buffer encoding documentation.
+static const int kTagTypeBits = 3;
+static const uint32_t kTagTypeMask = (1 << kTagTypeBits) - 1;
+enum WireType {
+  kWireTypeVarint = 0,
+  kWireTypeFixed64 = 1,
+  kWireTypeLengthDelimited = 2,
+  kWireTypeFixed32 = 5,
+};
+
+// Reads a varint field into value, if it has the expected wire type
+static bool ReadVarint(CodedInputStream* input, uint32_t tag, int* value) {
+  uint32_t varint;
+  if ((tag & kTagTypeMask) != kWireTypeVarint ||
+      !input->ReadVarint32(&varint)) {
+    return false;
+  }
+  *value = static_cast<int>(varint);
+  return true;
+}
+
+// Skips a field Datum does not describe. Groups are deprecated and do not
+// occur in Datum records, so they are treated as malformed.
+static bool SkipField(CodedInputStream* input, uint32_t tag) {
+  google::protobuf::uint64 value64;
+  google::protobuf::uint32 value32;
+  switch (tag & kTagTypeMask) {
+  case kWireTypeVarint:
+    return input->ReadVarint64(&value64);
+  case kWireTypeFixed64:
+    return input->ReadLittleEndian64(&value64);
+  case kWireTypeLengthDelimited:
+    return input->ReadVarint32(&value32) && input->Skip(value32);
+  case kWireTypeFixed32:
+    return input->ReadLittleEndian32(&value32);
+  default:
+    return false;
+  }
+}
+
+bool ParseDatumView(const char* buffer, size_t size, DatumView* view) {
+  *view = DatumView();
+  if (size > INT_MAX) {
+    return false;
+  }
+  CodedInputStream input(reinterpret_cast<const uint8_t*>(buffer), size);
+  uint32_t tag;
+  int encoded;
+  while ((tag = input.ReadTag()) != 0) {
+    switch (tag >> kTagTypeBits) {
+    case Datum::kChannelsFieldNumber:
+      if (!ReadVarint(&input, tag, &view->channels)) return false;
+      break;
+    case Datum::kHeightFieldNumber:
+      if (!ReadVarint(&input, tag, &view->height)) return false;
+      break;
+    case Datum::kWidthFieldNumber:
+      if (!ReadVarint(&input, tag, &view->width)) return false;
+      break;
+    case Datum::kLabelFieldNumber:
+      if (!ReadVarint(&input, tag, &view->label)) return false;
+      break;
+    case Datum::kEncodedFieldNumber:
+      if (!ReadVarint(&input, tag, &encoded)) return false;
+      view->encoded = encoded != 0;
+      break;
+    case Datum::kDataFieldNumber: {
+      uint32_t length;
+      if ((tag & kTagTypeMask) != kWireTypeLengthDelimited ||
+          !input.ReadVarint32(&length)) {
+        return false;
+      }
+      view->data = NULL;
+      view->size = length;
+      if (length == 0) {
+        break;
+      }
+      // The stream reads straight from the buffer, so this points into it
+      const void* data;
+      int available;
+      if (!input.GetDirectBufferPointer(&data, &available) ||
+          static_cast<uint32_t>(available) < length) {
+        return false;
+      }
+      view->data = static_cast<const uint8_t*>(data);
+      input.Skip(length);
+      break;
+    }
+    case Datum::kFloatDataFieldNumber:
+      return false;
+    default:
+      if (!SkipField(&input, tag)) return false;
+    }
+  }
+  return input.ExpectAtEnd();
+}
+
+}  // namespace caffe
@@ -3,9 +3,34 @@
 #include "caffe/util/db_lmdb.hpp"
 
 #include <string>
+#include <vector>
 
 namespace caffe { namespace db {
 
+int Cursor::ReadBatch(int n, vector<RecordView>* values) {
+  batch_values_.resize(n);
+  int count = 0;
+  for (; count < n && valid(); ++count) {
+    batch_values_[count] = value();
+    Next();
+  }
+  values->resize(count);
+  for (int i = 0; i < count; ++i) {
+    (*values)[i].data = batch_values_[i].data();
+    (*values)[i].size = batch_values_[i].size();
+  }
+  return count;
+}
+
+int64_t DB::Count() {
+  shared_ptr<Cursor> cursor(NewCursor());
+  int64_t count = 0;
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+    ++count;
+  }
+  return count;
+}
+
 DB* GetDB(DataParameter::DB backend) {
   switch (backend) {
 #ifdef USE_LEVELDB
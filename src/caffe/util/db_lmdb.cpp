@@ -1,12 +1,192 @@
 #ifdef USE_LMDB
 #include "caffe/util/db_lmdb.hpp"
 
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <boost/thread.hpp>
 #include <string>
+#include <vector>
+
+#include "caffe/internal_thread.hpp"
 
 namespace caffe { namespace db {
 
+/**
+ * Walks a second cursor up to a given number of records ahead of an
+ * LMDBCursor. For every record it passes it advises the kernel that the
+ * pages of the value will be needed and touches them, so that the reader
+ * finds them resident instead of stalling on page faults.
+ */
+class LMDBReadahead : public InternalThread {
+ public:
+  LMDBReadahead(MDB_env* mdb_env, MDB_dbi mdb_dbi, const string& start_key,
+      int records, int64_t span)
+    : mdb_env_(mdb_env), mdb_dbi_(mdb_dbi), start_key_(start_key),
+      records_(records), span_(span), lead_(0), restart_(false), sink_(0) { }
+  virtual ~LMDBReadahead() { StopInternalThread(); }
+
+  // The reader moved past n records
+  void Advance(int n) {
+    boost::mutex::scoped_lock lock(mutex_);
+    lead_ -= n;
+    cond_.notify_one();
+  }
+  // The reader went back to the first record whose key is not less than
+  // key, or to the first record if key is empty
+  void Restart(const string& key) {
+    boost::mutex::scoped_lock lock(mutex_);
+    restart_ = true;
+    restart_key_ = key;
+    cond_.notify_one();
+  }
+
+ protected:
+  virtual void InternalThreadEntry();
+  void Touch(const MDB_val& value);
+
+  MDB_env* mdb_env_;
+  MDB_dbi mdb_dbi_;
+  // The range the reader is confined to: span_ records from start_key_ on,
+  // or all of them if span_ is 0
+  string start_key_;
+  const int records_;
+  const int64_t span_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  // Position of the next record to warm, relative to the reader. It is
+  // negative when the reader has overtaken the readahead.
+  int lead_;
+  bool restart_;
+  string restart_key_;
+  volatile char sink_;
+};
+
+void LMDBReadahead::Touch(const MDB_val& value) {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  const char* data = static_cast<const char*>(value.mv_data);
+  char* page = reinterpret_cast<char*>(
+      reinterpret_cast<uintptr_t>(data) & ~(page_size - 1));
+  madvise(page, data + value.mv_size - page, MADV_WILLNEED);
+  for (const char* p = data; p < data + value.mv_size; p += page_size) {
+    sink_ += *p;
+  }
+}
+
+void LMDBReadahead::InternalThreadEntry() {
+  MDB_txn* mdb_txn;
+  MDB_cursor* mdb_cursor;
+  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, MDB_RDONLY, &mdb_txn));
+  MDB_CHECK(mdb_cursor_open(mdb_txn, mdb_dbi_, &mdb_cursor));
+  MDB_val mdb_key, mdb_value;
+  MDB_cursor_op op = MDB_FIRST;
+  // Records warmed since the start of the range
+  int64_t position = 0;
+  bool wrap = true;
+  try {
+    while (!must_stop()) {
+      bool warm;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (lead_ >= records_ && !restart_) {
+          cond_.wait(lock);
+        }
+        if (restart_) {
+          start_key_ = restart_key_;
+          wrap = true;
+          lead_ = 0;
+          restart_ = false;
+        }
+        warm = lead_ >= 0;
+        ++lead_;
+      }
+      int mdb_status = MDB_NOTFOUND;
+      if (!wrap && (span_ == 0 || position < span_)) {
+        mdb_status = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_value, op);
+      }
+      if (mdb_status == MDB_NOTFOUND) {
+        // go back to the start of the range like the reader does
+        mdb_key.mv_size = start_key_.size();
+        mdb_key.mv_data = const_cast<char*>(start_key_.data());
+        mdb_status = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_value,
+            start_key_.empty() ? MDB_FIRST : MDB_SET_RANGE);
+        if (mdb_status == MDB_NOTFOUND) {
+          break;  // empty range
+        }
+        position = 0;
+        wrap = false;
+      }
+      MDB_CHECK(mdb_status);
+      ++position;
+      op = MDB_NEXT;
+      if (warm) {
+        Touch(mdb_value);
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // stopped while waiting for the reader
+  }
+  mdb_cursor_close(mdb_cursor);
+  mdb_txn_abort(mdb_txn);
+}
+
+LMDBCursor::~LMDBCursor() {
+  readahead_.reset();
+  mdb_cursor_close(mdb_cursor_);
+  mdb_txn_abort(mdb_txn_);
+}
+
+void LMDBCursor::SeekToFirst() {
+  Seek(MDB_FIRST);
+  if (readahead_) {
+    readahead_->Restart(string());
+  }
+}
+
+void LMDBCursor::Seek(const string& key) {
+  mdb_key_.mv_size = key.size();
+  mdb_key_.mv_data = const_cast<char*>(key.data());
+  Seek(MDB_SET_RANGE);
+  if (readahead_) {
+    readahead_->Restart(key);
+  }
+}
+
+void LMDBCursor::Next() {
+  Seek(MDB_NEXT);
+  if (readahead_) {
+    readahead_->Advance(1);
+  }
+}
+
+int LMDBCursor::ReadBatch(int n, vector<RecordView>* values) {
+  values->clear();
+  while (values->size() < n && valid_) {
+    RecordView value;
+    value.data = static_cast<const char*>(mdb_value_.mv_data);
+    value.size = mdb_value_.mv_size;
+    values->push_back(value);
+    Seek(MDB_NEXT);
+  }
+  if (readahead_) {
+    readahead_->Advance(values->size());
+  }
+  return values->size();
+}
+
+void LMDBCursor::StartReadahead(int records, int64_t span) {
+  CHECK(!readahead_) << "Readahead already started";
+  if (records <= 0) {
+    return;
+  }
+  MDB_dbi mdb_dbi = mdb_cursor_dbi(mdb_cursor_);
+  readahead_.reset(new LMDBReadahead(mdb_txn_env(mdb_txn_), mdb_dbi,
+      valid_ ? key() : string(), records, span));
+  readahead_->StartInternalThread();
+}
+
 void LMDB::Open(const string& source, Mode mode) {
   MDB_CHECK(mdb_env_create(&mdb_env_));
   if (mode == NEW) {
@@ -44,6 +224,12 @@ LMDBCursor* LMDB::NewCursor() {
   return new LMDBCursor(mdb_txn, mdb_cursor);
 }
 
+int64_t LMDB::Count() {
+  MDB_stat mdb_stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &mdb_stat));
+  return mdb_stat.ms_entries;
+}
+
 LMDBTransaction* LMDB::NewTransaction() {
   return new LMDBTransaction(mdb_env_);
 }
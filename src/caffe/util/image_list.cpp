@@ -0,0 +1,147 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/image_list.hpp"
+
+namespace caffe {
+
+static const char kImageListMagic[8] = {'C', 'A', 'F', 'F', 'E', 'I', 'M', 'L'};
+static const uint32_t kImageListVersion = 1;
+
+ImageList::ImageList()
+    : entries_(NULL), pool_(NULL), num_entries_(0), pool_size_(0),
+      map_(NULL), map_size_(0) {}
+
+ImageList::~ImageList() {
+  Close();
+}
+
+void ImageList::Open(const string& source) {
+  Close();
+  std::ifstream infile(source.c_str(), std::ios::binary);
+  CHECK(infile.good()) << "Failed to open image list " << source;
+  char magic[sizeof(kImageListMagic)];
+  infile.read(magic, sizeof(magic));
+  const bool binary = infile.gcount() == sizeof(magic) &&
+      memcmp(magic, kImageListMagic, sizeof(magic)) == 0;
+  infile.close();
+  if (binary) {
+    Map(source);
+  } else {
+    ParseText(source);
+  }
+}
+
+void ImageList::Close() {
+  if (map_) {
+    munmap(map_, map_size_);
+    map_ = NULL;
+    map_size_ = 0;
+  }
+  vector<ImageListEntry>().swap(text_entries_);
+  vector<char>().swap(text_pool_);
+  entries_ = NULL;
+  pool_ = NULL;
+  num_entries_ = 0;
+  pool_size_ = 0;
+}
+
+void ImageList::ParseText(const string& source) {
+  std::ifstream infile(source.c_str());
+  CHECK(infile.good()) << "Failed to open image list " << source;
+  string line;
+  while (std::getline(infile, line)) {
+    const size_t end = line.find_last_not_of(" \t\r");
+    if (end == string::npos) {
+      continue;  // blank line
+    }
+    const size_t pos = line.find_last_of(" \t", end);
+    CHECK_NE(pos, string::npos) << "No label in line \"" << line << "\" of "
+        << source;
+    const size_t name_end = line.find_last_not_of(" \t", pos);
+    CHECK_NE(name_end, string::npos) << "No file name in line \"" << line
+        << "\" of " << source;
+    // The label is the whole last field and must fit an int
+    const char* label = line.c_str() + pos + 1;
+    char* label_end;
+    errno = 0;
+    const long value = strtol(label, &label_end, 10);  // NOLINT(runtime/int)
+    CHECK(label_end == line.c_str() + end + 1 && errno == 0 &&
+        value >= INT_MIN && value <= INT_MAX)
+        << "Invalid label in line \"" << line << "\" of " << source;
+    ImageListEntry entry;
+    entry.offset = text_pool_.size();
+    entry.length = name_end + 1;
+    entry.label = value;
+    text_pool_.insert(text_pool_.end(), line.begin(),
+        line.begin() + name_end + 1);
+    text_entries_.push_back(entry);
+  }
+  num_entries_ = text_entries_.size();
+  pool_size_ = text_pool_.size();
+  entries_ = num_entries_ ? &text_entries_[0] : NULL;
+  pool_ = pool_size_ ? &text_pool_[0] : NULL;
+}
+
+void ImageList::Map(const string& source) {
+  const int fd = open(source.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "Failed to open image list " << source;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat image list " << source;
+  map_size_ = st.st_size;
+  map_ = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(map_ != MAP_FAILED) << "Failed to map image list " << source;
+
+  CHECK_GE(map_size_, sizeof(ImageListHeader)) << "Truncated image list "
+      << source;
+  const ImageListHeader* header = static_cast<const ImageListHeader*>(map_);
+  CHECK_EQ(header->version, kImageListVersion)
+      << "Unsupported image list version in " << source;
+  // Compared piecewise, so that no corrupt count can overflow the sum
+  const size_t body_size = map_size_ - sizeof(ImageListHeader);
+  CHECK_LE(header->num_entries, body_size / sizeof(ImageListEntry))
+      << "Truncated image list " << source;
+  num_entries_ = header->num_entries;
+  CHECK_LE(header->pool_size, body_size - num_entries_ * sizeof(ImageListEntry))
+      << "Truncated image list " << source;
+  pool_size_ = header->pool_size;
+  entries_ = reinterpret_cast<const ImageListEntry*>(header + 1);
+  pool_ = reinterpret_cast<const char*>(entries_ + num_entries_);
+  // name() does not check its entry, so every name must lie in the pool
+  for (size_t i = 0; i < num_entries_; ++i) {
+    CHECK(entries_[i].offset <= pool_size_ &&
+        entries_[i].length <= pool_size_ - entries_[i].offset)
+        << "Entry " << i << " of image list " << source
+        << " points past its name pool";
+  }
+}
+
+void WriteImageList(const ImageList& list, const string& filename) {
+  std::ofstream outfile(filename.c_str(),
+      std::ios::out | std::ios::binary | std::ios::trunc);
+  CHECK(outfile.good()) << "Failed to open " << filename;
+  ImageListHeader header;
+  memcpy(header.magic, kImageListMagic, sizeof(header.magic));
+  header.version = kImageListVersion;
+  header.reserved = 0;
+  header.num_entries = list.num_entries_;
+  header.pool_size = list.pool_size_;
+  outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  outfile.write(reinterpret_cast<const char*>(list.entries_),
+      list.num_entries_ * sizeof(ImageListEntry));
+  outfile.write(list.pool_, list.pool_size_);
+  CHECK(outfile.good()) << "Failed to write " << filename;
+}
+
+}  // namespace caffe
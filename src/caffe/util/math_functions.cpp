@@ -9,6 +9,30 @@
 
 namespace caffe {
 
+BlasSingleThread::BlasSingleThread(bool enable) : threads_(0) {
+  if (!enable) {
+    return;
+  }
+#if defined(USE_MKL)
+  threads_ = mkl_get_max_threads();
+  mkl_set_num_threads(1);
+#elif defined(USE_OPENBLAS)
+  threads_ = openblas_get_num_threads();
+  openblas_set_num_threads(1);
+#endif
+}
+
+BlasSingleThread::~BlasSingleThread() {
+  if (threads_ <= 1) {
+    return;
+  }
+#if defined(USE_MKL)
+  mkl_set_num_threads(threads_);
+#elif defined(USE_OPENBLAS)
+  openblas_set_num_threads(threads_);
+#endif
+}
+
 template<>
 void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
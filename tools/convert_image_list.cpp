@@ -0,0 +1,47 @@
+// This program converts a text list of images and labels, as read by the
+// ImageData and LabelData layers, to the binary list format that these
+// layers memory-map instead of parsing.
+// Usage:
+//   convert_image_list LISTFILE OUTFILE
+//
+// where LISTFILE is a list of files as well as their labels, in the format
+//   subfolder1/file1.JPEG 7
+//   ....
+// OUTFILE can be used as the source of the layers in place of LISTFILE.
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_list.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert a text list of images and labels to the\n"
+        "binary list format of the ImageData and LabelData layers.\n"
+        "Usage:\n"
+        "    convert_image_list LISTFILE OUTFILE\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_image_list");
+    return 1;
+  }
+
+  ImageList list;
+  list.Open(argv[1]);
+  CHECK(!list.mapped()) << argv[1] << " is already a binary list";
+  LOG(INFO) << "A total of " << list.size() << " images.";
+  WriteImageList(list, argv[2]);
+  LOG(INFO) << "Wrote " << argv[2];
+  return 0;
+}
@@ -0,0 +1,149 @@
+// Times the forward pass of the CPU convolution engines on the layer shapes
+// of common image classification networks.
+// Usage:
+//    convolution_benchmark [--batch=1] [--iterations=10]
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::ConvolutionParameter;
+using caffe::ConvolutionParameter_Engine;
+using caffe::ConvolutionParameter_Engine_Name;
+using caffe::CPUTimer;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::LayerRegistry;
+using caffe::shared_ptr;
+using caffe::vector;
+
+DEFINE_int32(batch, 1, "The number of images of each forward pass.");
+DEFINE_int32(iterations, 10, "The number of timed forward passes.");
+
+struct ConvolutionShape {
+  const char* name;
+  int channels;
+  int size;
+  int num_output;
+  int kernel_size;
+  int stride;
+  int pad;
+  int group;
+};
+
+static const ConvolutionShape kShapes[] = {
+  {"vgg conv1_1", 3, 224, 64, 3, 1, 1, 1},
+  {"vgg conv1_2", 64, 224, 64, 3, 1, 1, 1},
+  {"vgg conv2_2", 128, 112, 128, 3, 1, 1, 1},
+  {"vgg conv3_2", 256, 56, 256, 3, 1, 1, 1},
+  {"vgg conv4_2", 512, 28, 512, 3, 1, 1, 1},
+  {"vgg conv5_2", 512, 14, 512, 3, 1, 1, 1},
+  {"resnet conv1", 3, 224, 64, 7, 2, 3, 1},
+  {"resnet res2 3x3", 64, 56, 64, 3, 1, 1, 1},
+  {"resnet res3 3x3", 128, 28, 128, 3, 1, 1, 1},
+  {"resnet res4 3x3", 256, 14, 256, 3, 1, 1, 1},
+  {"resnet res5 3x3", 512, 7, 512, 3, 1, 1, 1},
+  {"resnet res2 1x1", 256, 56, 64, 1, 1, 0, 1},
+  {"resnet res3 1x1/2", 256, 56, 512, 1, 2, 0, 1},
+  {"resnext 3x3 32x4d", 128, 56, 128, 3, 1, 1, 32},
+  {"mobilenet dw 3x3", 128, 56, 128, 3, 1, 1, 128},
+  {"mobilenet dw 3x3/2", 512, 14, 512, 3, 2, 1, 512},
+};
+
+static const ConvolutionParameter_Engine kEngines[] = {
+  caffe::ConvolutionParameter_Engine_CAFFE,
+  caffe::ConvolutionParameter_Engine_DIRECT,
+  caffe::ConvolutionParameter_Engine_WINOGRAD,
+};
+
+// Returns the average milliseconds of a forward pass and leaves its output in
+// top.
+float TimeForward(const ConvolutionShape& shape,
+    ConvolutionParameter_Engine engine, Blob<float>* bottom, Blob<float>* top) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(shape.num_output);
+  convolution_param->add_kernel_size(shape.kernel_size);
+  convolution_param->add_stride(shape.stride);
+  convolution_param->add_pad(shape.pad);
+  convolution_param->set_group(shape.group);
+  convolution_param->set_engine(engine);
+  // The same seed gives every engine the same weights
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_weight_filler()->set_std(0.01);
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  Caffe::set_random_seed(1701);
+  shared_ptr<Layer<float> > layer =
+      LayerRegistry<float>::CreateLayer(layer_param);
+  vector<Blob<float>*> bottom_vec(1, bottom);
+  vector<Blob<float>*> top_vec(1, top);
+  layer->SetUp(bottom_vec, top_vec);
+  // Warm up caches and allocations
+  layer->Forward(bottom_vec, top_vec);
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    layer->Forward(bottom_vec, top_vec);
+  }
+  timer.Stop();
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Times the CPU convolution engines.\n"
+      "Usage:\n"
+      "    convolution_benchmark [--batch=1] [--iterations=10]");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GT(FLAGS_batch, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+  Caffe::set_mode(Caffe::CPU);
+  const int num_shapes = sizeof(kShapes) / sizeof(kShapes[0]);
+  const int num_engines = sizeof(kEngines) / sizeof(kEngines[0]);
+  for (int s = 0; s < num_shapes; ++s) {
+    const ConvolutionShape& shape = kShapes[s];
+    Blob<float> bottom(FLAGS_batch, shape.channels, shape.size, shape.size);
+    caffe::caffe_rng_gaussian<float>(bottom.count(), 0, 1,
+        bottom.mutable_cpu_data());
+    Blob<float> reference;
+    float reference_ms = 0;
+    for (int e = 0; e < num_engines; ++e) {
+      // DIRECT only takes depthwise and narrow grouped layers
+      if (kEngines[e] == caffe::ConvolutionParameter_Engine_DIRECT &&
+          shape.num_output / shape.group >=
+          caffe::DirectConvolutionLayer<float>::kMaxGroupOutputs) {
+        continue;
+      }
+      Blob<float> top;
+      const float ms = TimeForward(shape, kEngines[e], &bottom, &top);
+      float max_error = 0;
+      if (e == 0) {
+        reference.CopyFrom(top, false, true);
+        reference_ms = ms;
+      } else {
+        for (int i = 0; i < top.count(); ++i) {
+          max_error = std::max(max_error,
+              std::fabs(top.cpu_data()[i] - reference.cpu_data()[i]));
+        }
+      }
+      LOG(INFO) << shape.name << "\t"
+          << ConvolutionParameter_Engine_Name(kEngines[e]) << "\t"
+          << ms << " ms\tspeedup " << reference_ms / ms
+          << "\tmax error " << max_error;
+    }
+  }
+  return 0;
+}